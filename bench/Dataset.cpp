@@ -0,0 +1,79 @@
+#include <dnskeeper.h>
+#include <Dataset.hpp>
+
+#include <map>
+#include <random>
+
+namespace {
+
+std::string ip_of(size_t n)
+{
+    return "10." + std::to_string((n >> 16) & 0xff) + "." +
+           std::to_string((n >> 8) & 0xff) + "." +
+           std::to_string(n & 0xff);
+}
+
+} // anonymous namespace (private)
+
+dataset_t generate(size_t clusters, size_t servers, size_t records)
+{
+    dataset_t data;
+    data.domain_name = "bench.example.com";
+    clusters = std::max<size_t>(clusters, 1);
+
+    std::mt19937 rng(42);
+    std::bernoulli_distribution in_rotation(0.8);
+    std::bernoulli_distribution stale(0.05);
+
+    // Addresses published per subdomain
+    std::vector<std::vector<std::string>> published(std::max(clusters, records));
+
+    for (size_t id = 0; id < servers; id++)
+    {
+        size_t cluster = id % clusters;
+        std::string subdomain = "cluster" + std::to_string(cluster);
+        std::string ip = ip_of(id + 1);
+        SrvCache::row_t row = {std::to_string(id + 1),
+                               ip,
+                               "server-" + std::to_string(id + 1),
+                               std::to_string(cluster + 1),
+                               "Cluster " + std::to_string(cluster),
+                               subdomain};
+        data.servers.push_back(std::move(row));
+
+        if (in_rotation(rng))
+            published[cluster].push_back(ip);
+    }
+
+    for (size_t n = 0; n < records; n++)
+    {
+        // Addresses that are no longer in the inventory
+        auto &ips = published[n];
+        if (n >= clusters || stale(rng))
+            ips.push_back(ip_of(servers + n + 1));
+
+        auto name = (n < clusters ? "cluster" : "unknown") + std::to_string(n) +
+                    "." + data.domain_name + ".";
+        auto rrs = DnsHandler::rrset_t().WithName(name)
+                                        .WithType(Model::RRType::A)
+                                        .WithTTL(60);
+        for (const auto &ip : ips)
+            rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip));
+        data.rrsets.push_back(std::move(rrs));
+    }
+
+    DnsHandler::zone_t zone;
+    DnsHandler::load_rrsets(zone, data.rrsets);
+    data.records = std::move(zone.records);
+    return data;
+}
+
+const dataset_t &dataset(size_t clusters, size_t servers, size_t records)
+{
+    static std::map<std::tuple<size_t, size_t, size_t>, dataset_t> cache;
+    auto key = std::make_tuple(clusters, servers, records);
+    auto it = cache.find(key);
+    if (it == cache.end())
+        it = cache.emplace(key, generate(clusters, servers, records)).first;
+    return it->second;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+// Synthetic inventory and hosted zone, shaped like production data:
+// one subdomain (and A record) per cluster, servers spread evenly over
+// the clusters, most of them in rotation. Generation is deterministic
+struct dataset_t
+{
+    std::string domain_name;
+    SrvCache::records_t servers;             // As returned by get_servers()
+    Aws::Vector<DnsHandler::rrset_t> rrsets; // As listed by Route53
+    DnsHandler::records_t records;           // As returned by list_records()
+};
+
+// clusters: number of clusters (and subdomains)
+// servers:  servers in the inventory
+// records:  A records in the zone. Records beyond the
+//           cluster count point at unknown subdomains
+dataset_t generate(size_t clusters, size_t servers, size_t records);
+
+// Datasets are cached, benchmarks sharing a shape share the data
+const dataset_t &dataset(size_t clusters, size_t servers, size_t records);
@@ -0,0 +1,132 @@
+#include <dnskeeper.h>
+
+#include <benchmark/benchmark.h>
+
+#include <Dataset.hpp>
+#include <Pages.hpp>
+#include <Reconciler.hpp>
+
+// Benchmarks take (clusters, servers, records) as arguments
+void shapes(benchmark::internal::Benchmark *b)
+{
+    b->Args({10, 100, 10});
+    b->Args({100, 1000, 100});
+    b->Args({1000, 10000, 1000});
+    b->Args({2000, 50000, 2500});
+    b->Unit(benchmark::kMicrosecond);
+}
+
+const dataset_t &dataset(const benchmark::State &state)
+{
+    return dataset(state.range(0), state.range(1), state.range(2));
+}
+
+// Route53 listing to list_records() rows
+void BM_ListRecordsConversion(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    for (auto _ : state)
+    {
+        DnsHandler::zone_t zone;
+        DnsHandler::load_rrsets(zone, data.rrsets);
+        benchmark::DoNotOptimize(zone.records.data());
+    }
+    state.SetItemsProcessed(state.iterations() * data.rrsets.size());
+}
+BENCHMARK(BM_ListRecordsConversion)->Apply(shapes);
+
+// Name, domain and IP validation of every /servers row
+void BM_ServerRowValidation(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    ServerUI ui;
+    ui.reserve(data.servers.size());
+    for (auto _ : state)
+    {
+        ui.clear();
+        bool add = false;
+        for (const auto &s : data.servers)
+        {
+            auto domain = s[SrvCache::SUBDOMAIN] + "." + data.domain_name;
+            if ((add = !add))
+                ui.addition(s[SrvCache::NAME], domain, s[SrvCache::IP_ADDR]);
+            else
+                ui.removal(s[SrvCache::NAME], domain, s[SrvCache::IP_ADDR]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * data.servers.size());
+}
+BENCHMARK(BM_ServerRowValidation)->Apply(shapes);
+
+// Inventory versus DNS diff shared by both pages
+void BM_Reconcile(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    for (auto _ : state)
+    {
+        Reconciler diff(data.records, data.servers, data.domain_name);
+        benchmark::DoNotOptimize(diff.present());
+    }
+    state.SetItemsProcessed(state.iterations() * data.servers.size());
+}
+BENCHMARK(BM_Reconcile)->Apply(shapes);
+
+// /servers: DNS records reconciled against the inventory
+void BM_ServersPage(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    for (auto _ : state)
+    {
+        ServerUI ui;
+        build_servers_page(ui, data.records, data.servers, data.domain_name);
+        benchmark::DoNotOptimize(ui);
+    }
+    state.SetItemsProcessed(state.iterations() * data.servers.size());
+}
+BENCHMARK(BM_ServersPage)->Apply(shapes);
+
+// /dns: DNS records joined with the servers they point at
+void BM_DnsPage(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    for (auto _ : state)
+    {
+        DnsUI ui;
+        build_dns_page(ui, data.records, data.servers, data.domain_name);
+        benchmark::DoNotOptimize(ui);
+    }
+    state.SetItemsProcessed(state.iterations() * data.records.size());
+}
+BENCHMARK(BM_DnsPage)->Apply(shapes);
+
+// Final page assembly
+void BM_TablePageRender(benchmark::State &state)
+{
+    const auto &data = dataset(state);
+    ServerUI ui;
+    build_servers_page(ui, data.records, data.servers, data.domain_name);
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        auto page = ui.render();
+        bytes += page.size();
+        benchmark::DoNotOptimize(page.data());
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_TablePageRender)->Apply(shapes);
+
+int main(int argc, char **argv)
+{
+    // The SDK allocator backs the generated record sets
+    Aws::SDKOptions options;
+    Aws::InitAPI(options);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+
+    Aws::ShutdownAPI(options);
+    return 0;
+}
@@ -0,0 +1,113 @@
+# Generates a C++ source embedding the web assets (cmake -P)
+#
+#   -DASSETS=<file;file;...>  Files to embed
+#   -DOUTPUT=<file.cpp>       Generated source
+#   -DGZIP=<gzip executable>  Used for the precompressed variants
+#
+# Templates (*.tpl) are split at their <!-- SLOT --> markers so pages
+# never have to search the template at runtime
+
+cmake_minimum_required(VERSION 3.11)
+
+function(hex_array name file out)
+    file(READ ${file} hex HEX)
+    string(LENGTH "${hex}" hexlen)
+    math(EXPR size "${hexlen} / 2")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+    set(${out} "static const unsigned char ${name}[] = {${hex}0x00};\n" PARENT_SCOPE)
+    set(${out}_size ${size} PARENT_SCOPE)
+endfunction()
+
+function(mime_type file out)
+    get_filename_component(ext ${file} EXT)
+    if(ext STREQUAL ".css")
+        set(${out} "text/css" PARENT_SCOPE)
+    elseif(ext STREQUAL ".html")
+        set(${out} "text/html" PARENT_SCOPE)
+    else()
+        set(${out} "text/plain" PARENT_SCOPE)
+    endif()
+endfunction()
+
+set(source "// Generated by etc/embed.cmake. Do not edit\n")
+string(APPEND source "#include <Assets.hpp>\n\n")
+set(table "")
+set(index 0)
+
+foreach(asset ${ASSETS})
+    get_filename_component(name ${asset} NAME)
+    mime_type(${asset} mime)
+
+    # Plain and gzip (-n keeps the output reproducible) variants
+    set(gzfile "${OUTPUT}.${index}.gz")
+    execute_process(
+        COMMAND ${GZIP} -9 -n -c ${asset}
+        OUTPUT_FILE ${gzfile}
+        RESULT_VARIABLE gzip_result)
+    if(NOT gzip_result EQUAL 0)
+        message(FATAL_ERROR "Failed to compress ${asset}")
+    endif()
+    hex_array("asset_${index}" ${asset} plain)
+    hex_array("asset_${index}_gz" ${gzfile} gz)
+    file(REMOVE ${gzfile})
+    string(APPEND source "${plain}${gz}")
+
+    file(SHA1 ${asset} digest)
+    string(SUBSTRING ${digest} 0 16 digest)
+
+    # Template segments: literal text followed by the slot it precedes
+    set(segments "")
+    set(segment_count 0)
+    if(name MATCHES "\\.tpl$")
+        file(READ ${asset} rest)
+        set(offset 0)
+        while(TRUE)
+            string(REGEX MATCH "<!-- (TITLE|SUBTITLE|NOTICE|HEADERS|ROWS) -->" marker "${rest}")
+            if(NOT marker)
+                string(LENGTH "${rest}" length)
+                string(APPEND segments "    {${offset}, ${length}, asset_t::NONE},\n")
+                math(EXPR segment_count "${segment_count} + 1")
+                break()
+            endif()
+            set(slot ${CMAKE_MATCH_1})
+            string(FIND "${rest}" "${marker}" length)
+            string(LENGTH "${marker}" marker_length)
+            string(APPEND segments "    {${offset}, ${length}, asset_t::${slot}},\n")
+            math(EXPR segment_count "${segment_count} + 1")
+            math(EXPR offset "${offset} + ${length} + ${marker_length}")
+            math(EXPR skip "${length} + ${marker_length}")
+            string(SUBSTRING "${rest}" ${skip} -1 rest)
+        endwhile()
+        string(APPEND source "static const asset_t::segment_t asset_${index}_segments[] = {\n${segments}};\n")
+        set(segment_ptr "asset_${index}_segments")
+    else()
+        set(segment_ptr "nullptr")
+    endif()
+    string(APPEND source "\n")
+
+    string(APPEND table "    {\"${name}\", \"${mime}\", "
+                        "asset_${index}, ${plain_size}, "
+                        "asset_${index}_gz, ${gz_size}, "
+                        "\"\\\"${digest}\\\"\", "
+                        "${segment_ptr}, ${segment_count}},\n")
+    math(EXPR index "${index} + 1")
+endforeach()
+
+string(APPEND source "static const asset_t assets[] = {\n${table}};\n\n")
+string(APPEND source [=[
+const asset_t *find_asset(const std::string &name)
+{
+    for (const auto &asset : assets)
+        if (name == asset.name)
+            return &asset;
+    return nullptr;
+}
+]=])
+
+# Only touch the output when it changes to avoid needless rebuilds
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+if(NOT "${previous}" STREQUAL "${source}")
+    file(WRITE ${OUTPUT} "${source}")
+endif()
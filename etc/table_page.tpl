@@ -29,6 +29,7 @@
         <H4>
         <!-- SUBTITLE -->
         </H4>
+        <!-- NOTICE -->
         <table class="basic">
             <thead>
                 <tr>
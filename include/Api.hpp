@@ -0,0 +1,44 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <Json.hpp>
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+// JSON API (v1). Documents are streamed from immutable snapshots, so a
+// response is consistent even while the zone or inventory changes
+namespace api {
+
+struct query_t
+{
+    std::string cursor = {};    // Last key of the previous page
+    size_t limit = 100;
+    std::string subdomain = {};
+    std::string cluster = {};   // Cluster name
+    std::string ip = {};
+};
+
+const size_t max_limit = 10000;
+
+// {"version":..,"items":[{"name","ttl","type","ips"}],"next_cursor":..}
+bool stream_records(const DnsHandler::snapshot_t &zone,
+                    const SrvCache::inventory_ptr &inventory,
+                    const query_t &query,
+                    JsonWriter::sink_t sink);
+
+// {"version":..,"items":[{"id","ip","name","cluster_id","cluster","subdomain"}],"next_cursor":..}
+bool stream_servers(const SrvCache::inventory_ptr &inventory,
+                    const query_t &query,
+                    JsonWriter::sink_t sink);
+
+// {"operations":[{"domain","ip","action":"add"|"remove"}]} (or just the array)
+const size_t max_operations = 10000;
+bool parse_mutations(const std::string &body,
+                     DnsHandler::mutations_t &ops,
+                     std::string &error);
+
+// {"ok":..,"results":[{"domain","ip","action","ok","change_id","error"}]}
+bool write_results(const DnsHandler::mutations_t &ops,
+                   JsonWriter::sink_t sink);
+
+} // namespace api
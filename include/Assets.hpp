@@ -0,0 +1,113 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string_view>
+
+// Web assets compiled into the binary by etc/embed.cmake
+struct asset_t
+{
+    // Template slots, in the order they appear in a template
+    enum slot_t
+    {
+        NONE = 0,
+        TITLE,
+        SUBTITLE,
+        NOTICE,
+        HEADERS,
+        ROWS
+    };
+
+    // Literal template text [offset, offset + length) followed by a slot
+    struct segment_t
+    {
+        size_t offset;
+        size_t length;
+        slot_t slot;
+    };
+
+    const char *name;
+    const char *mime;
+    const unsigned char *data;
+    size_t size;
+    const unsigned char *gzip;
+    size_t gzip_size;
+    const char *etag;           // Strong (quoted) content hash
+    const segment_t *segments;  // Only set for templates
+    size_t segment_count;
+
+    std::string_view view() const
+    {
+        return std::string_view(reinterpret_cast<const char *>(data), size);
+    }
+
+    std::string_view view(const segment_t &segment) const
+    {
+        return view().substr(segment.offset, segment.length);
+    }
+};
+
+const asset_t *find_asset(const std::string &name);
+
+// If-None-Match carries a list of (possibly weak) entity tags or "*"
+inline bool etag_matches(const std::string &if_none_match, const std::string &etag)
+{
+    if (if_none_match.empty())
+        return false;
+    if (if_none_match.find('*') != std::string::npos)
+        return true;
+
+    size_t pos = 0;
+    while ((pos = if_none_match.find(etag, pos)) != std::string::npos)
+    {
+        // Weak comparison, W/"x" matches "x"
+        if (pos == 0 || if_none_match[pos - 1] == ' '
+            || if_none_match[pos - 1] == ',' || if_none_match[pos - 1] == '/')
+            return true;
+        pos += etag.length();
+    }
+    return false;
+}
+
+// Accept-Encoding is a list of codings with optional q-values. gzip
+// (or "*" when gzip is not listed) is accepted unless its q is 0
+inline bool accepts_gzip(const std::string &accept_encoding)
+{
+    double gzip = -1, any = -1;
+    size_t start = 0;
+    while (start <= accept_encoding.size())
+    {
+        auto end = std::min(accept_encoding.find(',', start), accept_encoding.size());
+        std::string item = accept_encoding.substr(start, end - start);
+        start = end + 1;
+
+        auto semi = item.find(';');
+        std::string coding = item.substr(0, semi);
+        coding.erase(0, coding.find_first_not_of(" \t"));
+        coding.erase(coding.find_last_not_of(" \t") + 1);
+        for (auto &c : coding)
+            c = std::tolower(static_cast<unsigned char>(c));
+
+        double q = 1;
+        auto qpos = (semi == std::string::npos) ? semi : item.find("q=", semi);
+        if (qpos != std::string::npos)
+            q = std::strtod(item.c_str() + qpos + 2, nullptr);
+
+        if (coding == "gzip" || coding == "x-gzip")
+            gzip = q;
+        else if (coding == "*")
+            any = q;
+    }
+    return gzip >= 0 ? gzip > 0 : any > 0;
+}
+
+// Entity tag of the gzip body. A different representation of the same
+// content needs its own strong tag
+inline std::string gzip_etag(const std::string &etag)
+{
+    if (etag.size() < 2 || etag.back() != '"')
+        return etag + "-gz";
+    return etag.substr(0, etag.size() - 1) + "-gz\"";
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <map>
+#include <condition_variable>
+
+// Tracks submitted Route53 changes until they reach INSYNC. A single
+// background thread polls every outstanding change with per-change
+// exponential backoff, so callers never block on propagation
+class ChangeTracker
+{
+public: // Types
+    enum class status_t
+    {
+        UNKNOWN = 0,
+        PENDING,
+        INSYNC,
+        FAILED
+    };
+    using clock_t = std::chrono::steady_clock;
+    using callback_t = std::function<void(const std::string & /*id*/, status_t)>;
+
+    // Queries the provider for a change. Returns false on a (transient)
+    // API failure, otherwise sets insync accordingly
+    using poller_t = std::function<bool(const std::string & /*id*/, bool & /*insync*/)>;
+
+private:
+    struct change_t
+    {
+        status_t status = status_t::PENDING;
+        clock_t::time_point submitted;
+        clock_t::time_point next_poll;
+        clock_t::time_point completed;
+        clock_t::duration backoff;
+        std::vector<callback_t> callbacks;
+    };
+
+    ChangeTracker(const ChangeTracker &) = delete;
+    ChangeTracker operator=(const ChangeTracker &) = delete;
+    ChangeTracker() = delete;
+
+    poller_t m_poller;
+    const clock_t::duration m_min_backoff = 1s;
+    const clock_t::duration m_max_backoff = 16s;
+    const clock_t::duration m_timeout;     // PENDING longer than this is FAILED
+    const clock_t::duration m_retention = 1h; // Completed changes stay queryable
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;      // Wakes the poller
+    std::condition_variable m_done_cv; // Wakes callers in wait()
+    std::map<std::string, change_t> m_changes;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    void poll_loop();
+
+public:
+    ChangeTracker(poller_t poller, std::chrono::seconds timeout = 120s);
+    ~ChangeTracker();
+
+    static const char *to_string(status_t status);
+
+    std::string track(const std::string &id, callback_t cb = nullptr);
+    status_t status(const std::string &id);
+    status_t wait(const std::string &id, std::chrono::seconds timeout);
+    size_t pending();
+};
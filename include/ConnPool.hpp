@@ -0,0 +1,72 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <memory>
+#include <condition_variable>
+
+#include <pqxx/pqxx>
+
+// Bounded pool of PostgreSQL connections. Connections are opened
+// lazily, validated on checkout and discarded once found broken
+class ConnPool
+{
+public: // Types
+    using conn_t = std::unique_ptr<pqxx::connection>;
+    using init_t = std::function<void(pqxx::connection &)>; // Runs on every new connection
+
+    // RAII checkout. Returns the connection to the pool on scope exit
+    class handle_t
+    {
+    private:
+        ConnPool *m_pool = nullptr;
+        conn_t m_conn;
+        bool m_broken = false;
+
+    public:
+        handle_t() = default;
+        handle_t(ConnPool *pool, conn_t conn)
+            : m_pool(pool), m_conn(std::move(conn))
+        {}
+        handle_t(handle_t &&) = default;
+        handle_t &operator=(handle_t &&) = default;
+        ~handle_t()
+        {
+            if (m_pool && m_conn)
+                m_pool->release(std::move(m_conn), m_broken);
+        }
+
+        explicit operator bool() const { return m_conn != nullptr; }
+        pqxx::connection &operator*() { return *m_conn; }
+        pqxx::connection *operator->() { return m_conn.get(); }
+
+        // The connection is closed instead of being returned
+        void invalidate() { m_broken = true; }
+    };
+
+private:
+    ConnPool(const ConnPool &) = delete;
+    ConnPool operator=(const ConnPool &) = delete;
+    ConnPool() = delete;
+
+    const std::string m_url;
+    const size_t m_max_size;
+    const std::chrono::milliseconds m_timeout;
+    const init_t m_init;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::vector<conn_t> m_idle;
+    size_t m_open = 0; // Idle plus checked out
+
+    conn_t connect();
+    void release(conn_t conn, bool broken);
+
+public:
+    ConnPool(const std::string &url,
+             size_t max_size = 4,
+             std::chrono::milliseconds timeout = 5s,
+             init_t init = nullptr);
+
+    handle_t acquire();
+    size_t size();
+};
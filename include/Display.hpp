@@ -1,6 +1,8 @@
 #pragma once
 
 #include <dnskeeper.h>
+#include <Assets.hpp>
+#include <Metrics.hpp>
 
 // The HTML assumes 4 column rows. Changes to 
 // this requires modifications to the HTML 
@@ -24,58 +26,24 @@ inline const std::string& error_page() {
 class TablePage
 {
 private:
-    std::string m_template;
-    std::string m_page;
-    std::vector<std::string> m_rows;
+    // The page is assembled once around the rows slot. Rows are
+    // appended to a single buffer, so rendering is linear in the
+    // size of the output
+    std::string m_head;
+    std::string m_tail;
+    std::string m_rows;
+    size_t m_notice_at = std::string::npos; // Offset in m_head
+    std::string m_notice;
 
 protected:
     unsigned m_column_count = 0; // Verifies row data
-    std::string get_template(const std::string& filename)
-    {
-        std::string data;
-        if (std::filesystem::exists(filename))
-        {
-            std::string line;
-            std::ifstream fil(filename);
-            if (fil.is_open())
-            {
-                while (getline(fil, line))
-                    data += line;
-                fil.close();
-            }
-            return data;
-        } else {
-            return "";
-        }
-    }
-
-    bool inject(std::string& var, 
-                const std::string& placeholder, 
-                const std::string& data,
-                bool replace = false)
-    {
-        bool found = false;
-        size_t start_pos = 0;
-        while ((start_pos = var.find(placeholder, start_pos)) != std::string::npos)
-        {
-            found = true;
-            if(replace) {
-                var.replace(start_pos, placeholder.length(), data);
-                start_pos += data.length();
-            }
-            else{
-                var.insert(start_pos, data);
-                start_pos += data.length() + placeholder.length();
-            }
-        }
-        return found;
-    }
 
 public:
-    TablePage(const char *title, const char *subtitle, row_t colheaders)
+    TablePage(const char *title, const char *subtitle, const row_t& colheaders)
     {
-        m_template = get_template("./www/table_page.tpl");
-        if(m_template.empty()) {
+        // Embedded at build time and already split at its slots
+        const asset_t *tpl = find_asset("table_page.tpl");
+        if(!tpl || !tpl->segments) {
             LOG(ERROR) << "Page template " << title << " not found\n";
             exit(-1);
         }
@@ -89,25 +57,54 @@ public:
             m_column_count++;
         }
 
-        // Setup the title and subtitle
-        if(inject(m_template, "<!-- TITLE -->", title, true)
-            && inject(m_template, "<!-- SUBTITLE -->", subtitle, true)
-            && inject(m_template, "<!-- HEADERS -->", rowdata))
+        // Setup the title, subtitle and headers. Rows go between
+        // the head and the tail of the page
+        bool has_rows = false;
+        std::string *target = &m_head;
+        for (size_t i = 0; i < tpl->segment_count; i++)
         {
+            const auto &segment = tpl->segments[i];
+            target->append(tpl->view(segment));
+            switch (segment.slot)
+            {
+                case asset_t::TITLE:
+                    target->append(title);
+                    break;
+                case asset_t::SUBTITLE:
+                    target->append(subtitle);
+                    break;
+                case asset_t::NOTICE:
+                    m_notice_at = target == &m_head ? m_head.size() : std::string::npos;
+                    break;
+                case asset_t::HEADERS:
+                    target->append(rowdata);
+                    break;
+                case asset_t::ROWS:
+                    has_rows = true;
+                    target = &m_tail;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        if (has_rows) {
             LOG(DEBUG) << "Page template " << title << " initialized\n";
         } else {
-            // An injection failure is a critical code issue with the template
+            // A missing slot is a critical code issue with the template
             LOG(ERROR) << "Page template " << title << " failed initialization\n";
             exit(-1);
         }
-
-        m_page = m_template;
     }
 
-    void add_row(row_t row, bool highlight = false)
+    // Pre-sizes the row buffer for the expected number of rows
+    void reserve(size_t rows, size_t row_size = 256)
     {
-        std::string rowdata = "\n<tr>";
+        m_rows.reserve(rows * row_size);
+    }
 
+    void add_row(const row_t& row, bool highlight = false)
+    {
         if(row.size() != m_column_count) {
             // Issue with the data
             LOG(ERROR) << "Column header count does not match row data\n";
@@ -115,31 +112,49 @@ public:
         }
 
         if (highlight)
-            rowdata = "<tr class=\"flagged\">";
+            m_rows += "<tr class=\"flagged\">";
+        else
+            m_rows += "\n<tr>";
 
         for (const auto& cell : row)
         {
-            rowdata += "<td>";
-            rowdata += cell;
-            rowdata += "</td>";
+            m_rows += "<td>";
+            m_rows += cell;
+            m_rows += "</td>";
         }
 
-        rowdata += "</tr>";
-        m_rows.push_back(rowdata);
+        m_rows += "</tr>";
+    }
+
+    // Paragraph shown above the table, e.g. about the age of the data
+    void notice(const std::string &text)
+    {
+        m_notice = text.empty() ? "" : "<p class=\"notice\">" + text + "</p>";
     }
 
     void clear()
     {
-        m_page = m_template;
         m_rows.clear();
     }
 
     std::string render()
     {
-        for (const auto &tblrow : m_rows)
-            if(!inject(m_page, "<!-- ROWS -->", tblrow))
-                return error_page();
-        return m_page;
+        static auto &latency = metrics::histogram("dnskeeper_render_seconds",
+                                                  "Table page render time");
+        metrics::Timer timer(latency);
+        std::string page;
+        page.reserve(m_head.size() + m_notice.size() + m_rows.size() + m_tail.size());
+        if (m_notice_at == std::string::npos)
+            page += m_head;
+        else
+        {
+            page.append(m_head, 0, m_notice_at);
+            page += m_notice;
+            page.append(m_head, m_notice_at, std::string::npos);
+        }
+        page += m_rows;
+        page += m_tail;
+        return page;
     }
 };
 
@@ -166,7 +181,9 @@ public:
     }
 
     using TablePage::clear;
+    using TablePage::notice;
     using TablePage::render;
+    using TablePage::reserve;
     using TablePage::add_row;
 
 
@@ -186,5 +203,7 @@ public:
 
     using TablePage::add_row;
     using TablePage::clear;
+    using TablePage::notice;
     using TablePage::render;
+    using TablePage::reserve;
 };
\ No newline at end of file
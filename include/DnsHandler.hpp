@@ -1,6 +1,18 @@
 #pragma once
 #include <dnskeeper.h>
+#include <ChangeTracker.hpp>
+#include <DnsProvider.hpp>
+#include <Executor.hpp>
+#include <IpAddr.hpp>
+#include <Journal.hpp>
+#include <SingleFlight.hpp>
+#include <TokenBucket.hpp>
+#include <WriteQueue.hpp>
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <condition_variable>
 
 #include <aws/core/Aws.h>
 #include <aws/route53/Route53Client.h>
@@ -20,29 +32,208 @@ public: // Types
         TYPE,
         MAX_ROW
     };
-    using iplist_t = std::vector<std::string>;
+    using iplist_t = std::vector<IpAddr>;
     using row_t = std::tuple<std::string, iplist_t, long, char>;
     using rrset_t = Model::ResourceRecordSet;
+    using rrkey_t = std::pair<std::string /*FQDN*/, Model::RRType>;
     using records_t = std::vector<row_t>;
 
+    // A hosted zone at or below the domain. Public and private zones
+    // are managed alike, each with its own request budget
+    struct hosted_zone_t
+    {
+        std::string id;    // Without the /hostedzone/ prefix
+        std::string name;  // FQDN, with the trailing period
+        bool private_zone = false;
+        std::shared_ptr<TokenBucket> budget;
+    };
+
+    // Immutable copy of the hosted zones, merged. A refresh publishes a new
+    // zone_t, so readers holding a snapshot_t are never invalidated
+    struct zone_t
+    {
+        uint64_t version = 0;   // Bumped only when the content changes
+        std::chrono::system_clock::time_point fetched = {};
+        bool stale = false;     // Saved by an earlier run, not yet revalidated
+        records_t records;
+        std::map<rrkey_t, rrset_t> rrsets; // A and AAAA, the FQDN has the trailing period
+    };
+    using snapshot_t = std::shared_ptr<const zone_t>;
+
+    // A single address change. Results are filled in by apply()
+    enum class action_t
+    {
+        ADD = 0,
+        REMOVE
+    };
+    struct mutation_t
+    {
+        std::string name;
+        std::string ip;             // IPv4 or IPv6 text, validated by apply()
+        action_t action = action_t::ADD;
+        bool ok = false;
+        std::string change_id = {}; // Empty if nothing had to change
+        std::string error = {};
+    };
+    using mutations_t = std::vector<mutation_t>;
+
+    // Results of the asynchronous reads
+    struct listing_t
+    {
+        bool ok = false;
+        records_t records;
+    };
+    struct lookup_t
+    {
+        bool ok = false;
+        rrset_t rrset;
+    };
+
 private:
     DnsHandler(const DnsHandler &) = delete;
     DnsHandler operator=(const DnsHandler &) = delete;
     DnsHandler() = delete;
 
     Aws::SDKOptions m_options = {};
-    Aws::Http::URI m_domain;
-    std::string m_zone_id = {};
-    std::shared_ptr<Route53Client> m_client;
-    const Model::RRType m_dnstype = Model::RRType::A;
-    bool update(const rrset_t &rrs, bool = false);
+    std::string m_domain;
+    // Filled once by discover(), then never modified. Read it only
+    // once m_discovered is set
+    std::vector<hosted_zone_t> m_zones; // Longest name first
+    std::mutex m_zones_mtx;             // One discovery at a time
+    std::atomic<bool> m_discovered{false};
+    double m_zone_rate;                 // Requests per second per zone
+    std::shared_ptr<DnsProvider> m_client;
+
+    // Zone snapshot and the background refresh
+    std::mutex m_snapshot_mtx;
+    snapshot_t m_snapshot;
+    uint64_t m_writes = 0;  // Local writes published (guarded by m_snapshot_mtx)
+
+    // Local writes since the current refresh started listing, replayed
+    // onto its result (guarded by m_snapshot_mtx)
+    struct write_t
+    {
+        rrset_t rrs;
+        bool remove;
+    };
+    std::vector<write_t> m_recent;
+    std::chrono::seconds m_refresh_interval;
+    std::mutex m_refresh_mtx;
+    std::condition_variable m_refresh_cv;
+    bool m_stop = false;
+    std::thread m_refresher;
+
+    // Concurrent identical listings share one set of Route53 calls
+    SingleFlight<bool> m_refreshes;
+    SingleFlight<snapshot_t> m_subtrees; // Keyed by name and type
+
+    // Runs the asynchronous calls that have to reach Route53
+    std::unique_ptr<Executor> m_executor;
+
+    // Outstanding changes are polled in the background
+    std::unique_ptr<ChangeTracker> m_tracker;
+
+    std::mutex m_apply_mtx; // One read-modify-write of the zone at a time
+
+    // Optional, every apply() is recorded there (guarded by m_apply_mtx)
+    std::shared_ptr<Journal> m_journal;
+
+    // Single record writes are coalesced into batches. Declared after
+    // what apply() uses, as the queue drains through it when destroyed
+    std::unique_ptr<WriteQueue<mutation_t>> m_queue;
+
+    // The submission is journaled against the entry's operations
+    bool submit(const hosted_zone_t &hz, const Aws::Vector<Model::Change> &changes,
+                std::string &change_id, uint64_t entry = 0,
+                const std::vector<size_t> &entry_ops = {});
+
+    // Pages through a zone listing, from the subtree's name (and type)
+    // to its end. Empty subtree: the whole zone
+    using page_t = std::function<void(const Aws::Vector<rrset_t> &)>;
+    bool list_pages(const hosted_zone_t &hz, const std::string &subtree,
+                    Model::RRType type, const page_t &page);
+    bool fetch_zone(const hosted_zone_t &hz, zone_t &zone,
+                    const std::string &subtree = "",
+                    Model::RRType type = Model::RRType::NOT_SET);
+    bool fetch_zones(const std::vector<const hosted_zone_t *> &zones, zone_t &zone,
+                     const std::string &subtree = "",
+                     Model::RRType type = Model::RRType::NOT_SET);
+    static void add_rrsets(zone_t &zone, const Aws::Vector<rrset_t> &rrsets,
+                           const std::string &subtree = "");
+    static void index_records(zone_t &zone);
+    static void set_rrset(zone_t &zone, const rrset_t &rrs, bool remove);
+    void publish(const rrset_t &rrs, bool remove);
+
+    // Lists the hosted zones at and below the domain unless already
+    // done. False while Route53 cannot be reached; callers retry later
+    bool discover();
+    bool reload();
+    void refresh_loop();
 
 public:
-    DnsHandler(const std::string& domain);
+    // Provider calls are made through RateLimiter::process()
+    DnsHandler(const std::string& domain,
+               std::chrono::seconds refresh_interval = 30s,
+               std::chrono::milliseconds write_window = 50ms,
+               double zone_rate = 5,
+               std::shared_ptr<DnsProvider> provider = nullptr, // Route53 by default
+               snapshot_t seed = nullptr); // Served until the first refresh, made in the background
+    ~DnsHandler();
 
+    // Converts a Route53 listing into zone rows, keeping the address
+    // (A and AAAA) records
+    static void load_rrsets(zone_t &zone, const Aws::Vector<rrset_t> &rrsets);
+
+    // The reverse: rebuilds the RRsets of zone rows (e.g. a saved copy)
+    static void load_records(zone_t &zone, const records_t &records);
+
+    // A for IPv4, AAAA for IPv6
+    static Model::RRType type_of(const IpAddr &ip);
+
+    // Id of the zone named after the domain. All managed zones are
+    // discovered on the first successful call. Empty while Route53
+    // cannot be reached
     std::string get_hosted_zone();
-    bool list_records(records_t &dnsdata);
-    bool get_record(const std::string &name, rrset_t &);
+    std::vector<hosted_zone_t> hosted_zones();
+
+    // The zone a name is written to: the longest zone name that is a
+    // suffix of it on a label boundary. Null if no managed zone fits
+    const hosted_zone_t *zone_for(const std::string &name) const;
+
+    snapshot_t snapshot();
+    uint64_t version();
+    bool refresh();
+    bool list_records(records_t &dnsdata, bool live = false);
+
+    // Lists a name and every name below it live from Route53, starting
+    // at the given type of the name itself (NOT_SET: all its types).
+    // Zones delegated below the name are included
+    bool list_subtree(records_t &dnsdata, const std::string &name,
+                      Model::RRType type = Model::RRType::NOT_SET);
+    bool get_record(const std::string &name, rrset_t &, bool live = false,
+                    Model::RRType type = Model::RRType::A);
+    bool apply(mutations_t &ops);
+
+    // Starts journaling applies. Changes still pending at the last
+    // shutdown are polled again and operations that never reached
+    // Route53 are applied again. Returns the number of entries resumed
+    size_t resume(std::shared_ptr<Journal> journal);
     bool add_record(const std::string &name, const std::string &ip);
+    bool add_record(const std::string &name, const std::string &ip, std::string &change_id);
     bool delete_record(const std::string &name, const std::string &ip);
-};
\ No newline at end of file
+    bool delete_record(const std::string &name, const std::string &ip, std::string &change_id);
+
+    // Asynchronous counterparts. Reads the snapshot can answer complete
+    // at once, the others run on the handler's own workers (reads go
+    // live when there is no snapshot yet). Record changes join the
+    // write queue like their synchronous versions
+    std::future<listing_t> list_records_async(bool live = false);
+    std::future<lookup_t> get_record_async(const std::string &name, bool live = false,
+                                           Model::RRType type = Model::RRType::A);
+    std::future<mutation_t> add_record_async(const std::string &name, const std::string &ip);
+    std::future<mutation_t> delete_record_async(const std::string &name, const std::string &ip);
+
+    ChangeTracker::status_t change_status(const std::string &change_id);
+    ChangeTracker::status_t await_change(const std::string &change_id,
+                                         std::chrono::seconds timeout = 120s);
+};
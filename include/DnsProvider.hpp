@@ -0,0 +1,96 @@
+#pragma once
+#include <dnskeeper.h>
+#include <RateLimiter.hpp>
+
+#include <memory>
+
+#include <aws/core/Aws.h>
+#include <aws/route53/Route53Client.h>
+#include <aws/route53/model/ChangeResourceRecordSetsRequest.h>
+#include <aws/route53/model/GetChangeRequest.h>
+#include <aws/route53/model/ListHostedZonesByNameRequest.h>
+#include <aws/route53/model/ListResourceRecordSetsRequest.h>
+
+using namespace Aws::Route53;
+
+// The Route53 calls DnsHandler depends on. Calls mirror the SDK so
+// that Route53 itself and the emulator (load testing) are
+// interchangeable
+class DnsProvider
+{
+public:
+    virtual ~DnsProvider() = default;
+
+    virtual Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request) = 0;
+
+    virtual Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request) = 0;
+
+    virtual Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request) = 0;
+
+    virtual Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &request) = 0;
+};
+
+// Route53 through the AWS SDK. Needs Aws::InitAPI()
+class Route53Provider : public DnsProvider
+{
+private:
+    Route53Provider(const Route53Provider &) = delete;
+    Route53Provider operator=(const Route53Provider &) = delete;
+
+    std::shared_ptr<Route53Client> m_client;
+
+public:
+    Route53Provider();
+
+    Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request) override;
+
+    Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request) override;
+
+    Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request) override;
+
+    Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &request) override;
+};
+
+// Any provider behind the process-wide rate limiter. Retryable errors
+// (throttling, a change still in progress, unavailable service) are
+// retried with jittered backoff. Changes are not retried when the
+// outcome is unknown (network errors), as Route53 may have applied them
+class LimitedProvider : public DnsProvider
+{
+private:
+    LimitedProvider(const LimitedProvider &) = delete;
+    LimitedProvider operator=(const LimitedProvider &) = delete;
+    LimitedProvider() = delete;
+
+    std::shared_ptr<DnsProvider> m_provider;
+    RateLimiter &m_limiter;
+
+    template <typename F>
+    auto call(const char *name, RateLimiter::kind_t kind, F &&request);
+
+public:
+    static bool retryable(const Aws::Client::AWSError<Route53Errors> &error, RateLimiter::kind_t kind);
+
+    LimitedProvider(std::shared_ptr<DnsProvider> provider,
+                    RateLimiter &limiter = RateLimiter::process());
+
+    Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request) override;
+
+    Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request) override;
+
+    Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request) override;
+
+    Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &request) override;
+};
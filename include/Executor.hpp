@@ -0,0 +1,46 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <deque>
+#include <future>
+#include <condition_variable>
+
+// Fixed set of worker threads running tasks in submission order.
+// Destruction waits for the tasks already queued
+class Executor
+{
+public: // Types
+    using task_t = std::function<void()>;
+
+private:
+    Executor(const Executor &) = delete;
+    Executor operator=(const Executor &) = delete;
+    Executor() = delete;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::deque<task_t> m_tasks;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+
+    void work_loop();
+
+public:
+    explicit Executor(size_t workers);
+    ~Executor();
+
+    void post(task_t task);
+
+    // The task's result (or exception) is delivered through the future
+    template <typename F>
+    auto submit(F &&f) -> std::future<decltype(f())>
+    {
+        using result_t = decltype(f());
+        auto task = std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        post([task] { (*task)(); });
+        return result;
+    }
+
+    size_t queued();
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <array>
+#include <cstring>
+#include <string_view>
+
+// IPv4 or IPv6 address packed in 16 bytes. IPv4 addresses are held
+// IPv4-mapped (::ffff:a.b.c.d) so both families share one layout for
+// comparison, ordering and hashing. Parsing is strict: dotted quads
+// without leading zeros, RFC 4291 IPv6 text (no zone index)
+class IpAddr
+{
+private:
+    std::array<uint8_t, 16> m_bytes = {};
+
+public:
+    IpAddr() = default; // The unspecified address (::)
+    static IpAddr from_v4(uint32_t addr);
+    static IpAddr from_bytes(const uint8_t *bytes); // 16 bytes, as bytes()
+
+    // False (and addr untouched) unless the whole text is an address
+    static bool parse(std::string_view text, IpAddr &addr);
+    static bool valid(std::string_view text)
+    {
+        IpAddr addr;
+        return parse(text, addr);
+    }
+
+    bool is_v4() const;
+    uint32_t v4() const; // Only meaningful if is_v4()
+    const std::array<uint8_t, 16> &bytes() const { return m_bytes; }
+
+    // Canonical text (RFC 5952 for IPv6)
+    std::string to_string() const;
+    void append_to(std::string &out) const;
+
+    size_t hash() const
+    {
+        uint64_t hi, lo;
+        std::memcpy(&hi, m_bytes.data(), 8);
+        std::memcpy(&lo, m_bytes.data() + 8, 8);
+        return static_cast<size_t>((hi * 0x9E3779B97F4A7C15ull) ^ lo) * 0xC2B2AE3D27D4EB4Full;
+    }
+
+    bool operator==(const IpAddr &other) const { return m_bytes == other.m_bytes; }
+    bool operator!=(const IpAddr &other) const { return m_bytes != other.m_bytes; }
+    bool operator<(const IpAddr &other) const { return m_bytes < other.m_bytes; }
+};
+
+namespace std {
+template <>
+struct hash<IpAddr>
+{
+    size_t operator()(const IpAddr &addr) const { return addr.hash(); }
+};
+} // namespace std
@@ -0,0 +1,92 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <map>
+#include <set>
+#include <condition_variable>
+
+// Append-only log of record changes, so that a restart neither loses
+// nor repeats them. An entry is written (and synced) before any of its
+// operations is applied, then each Route53 submission, the end of the
+// apply and finally each change reaching INSYNC are recorded. Appends
+// are written and synced in batches by one thread. Only the intent
+// waits for the disk, later records are ordered behind it anyway.
+//
+// Records, one per line, fields escaped with %XX:
+//   O <seq> <index> <count> <A|R> <name> <ip>  operation of an entry
+//   C <seq> <change id> <index,...>             operations submitted
+//   D <seq>                                     apply returned
+//   S <change id>                               change INSYNC or given up
+class Journal
+{
+public: // Types
+    struct op_t
+    {
+        bool remove = false;
+        std::string name;
+        std::string ip;
+    };
+
+    // An entry that did not finish before the last shutdown
+    struct entry_t
+    {
+        uint64_t seq = 0;
+        std::vector<op_t> ops;
+        std::vector<bool> submitted;      // Per operation
+        std::vector<std::string> changes; // Submitted, not yet INSYNC
+        bool applied = false;             // Every operation was resolved
+    };
+
+private:
+    Journal(const Journal &) = delete;
+    Journal operator=(const Journal &) = delete;
+    Journal() = delete;
+
+    // Entries are live until applied and all their changes are synced
+    struct live_t
+    {
+        bool applied = false;
+        std::set<std::string> changes;
+    };
+
+    const std::string m_path;
+    const size_t m_max_size; // Truncated past this once nothing is live
+    int m_fd = -1;
+    size_t m_size = 0;       // Bytes written since the last truncation
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;      // Wakes the flusher
+    std::condition_variable m_sync_cv; // Wakes callers waiting for the disk
+    std::string m_buffer;
+    uint64_t m_written = 0;  // Appends queued
+    uint64_t m_synced = 0;   // Appends on disk
+    bool m_failed = false;
+    bool m_stop = false;
+    uint64_t m_seq = 0;
+    std::map<uint64_t, live_t> m_live;
+    std::map<std::string, uint64_t> m_change_seq;
+    std::thread m_flusher;
+
+    uint64_t append(const std::string &records); // Under m_mtx
+    void finish_if_done(uint64_t seq);           // Under m_mtx
+    void flush_loop();
+
+public:
+    explicit Journal(const std::string &path, size_t max_size = 1 << 20);
+    ~Journal();
+
+    bool ok();
+
+    // Reads the unfinished entries and compacts the file down to them.
+    // Call once, before any other use
+    std::vector<entry_t> recover();
+
+    // Records the operations, returns once they are on disk (0 if the
+    // journal cannot be written)
+    uint64_t begin(const std::vector<op_t> &ops);
+    void submitted(uint64_t seq, const std::string &change_id, const std::vector<size_t> &ops);
+    void applied(uint64_t seq);
+    void synced(const std::string &change_id);
+
+    size_t live(); // Unfinished entries
+};
@@ -0,0 +1,357 @@
+#pragma once
+#include <dnskeeper.h>
+
+// Minimal streaming JSON writer. Output is buffered and handed to the
+// sink in chunks, so memory stays bounded regardless of document size
+class JsonWriter
+{
+public: // Types
+    using sink_t = std::function<bool(const char *, size_t)>;
+
+private:
+    JsonWriter(const JsonWriter &) = delete;
+    JsonWriter operator=(const JsonWriter &) = delete;
+    JsonWriter() = delete;
+
+    sink_t m_sink;
+    const size_t m_chunk;
+    std::string m_buf;
+    std::vector<bool> m_first;  // Per open container, no element written yet
+    bool m_after_key = false;
+    bool m_ok = true;
+
+    void separate()
+    {
+        if (m_after_key)
+            m_after_key = false;
+        else if (!m_first.empty())
+        {
+            if (!m_first.back())
+                m_buf += ',';
+            m_first.back() = false;
+        }
+    }
+
+    void quoted(const std::string &data)
+    {
+        static const char hex[] = "0123456789abcdef";
+        m_buf += '"';
+        for (unsigned char c : data)
+        {
+            switch (c)
+            {
+                case '"':  m_buf += "\\\""; break;
+                case '\\': m_buf += "\\\\"; break;
+                case '\n': m_buf += "\\n"; break;
+                case '\r': m_buf += "\\r"; break;
+                case '\t': m_buf += "\\t"; break;
+                default:
+                    if (c < 0x20)
+                    {
+                        m_buf += "\\u00";
+                        m_buf += hex[c >> 4];
+                        m_buf += hex[c & 0xf];
+                    }
+                    else
+                        m_buf += static_cast<char>(c);
+            }
+        }
+        m_buf += '"';
+        if (m_buf.size() >= m_chunk)
+            flush();
+    }
+
+public:
+    JsonWriter(sink_t sink, size_t chunk = 16384)
+        : m_sink(sink), m_chunk(chunk)
+    {
+        m_buf.reserve(chunk + 256);
+    }
+
+    ~JsonWriter()
+    {
+        flush();
+    }
+
+    // False once the sink refused data (e.g. client went away)
+    bool ok() const { return m_ok; }
+
+    bool flush()
+    {
+        if (m_ok && !m_buf.empty())
+            m_ok = m_sink(m_buf.data(), m_buf.size());
+        m_buf.clear();
+        return m_ok;
+    }
+
+    JsonWriter &begin_object() { separate(); m_buf += '{'; m_first.push_back(true); return *this; }
+    JsonWriter &end_object() { m_buf += '}'; m_first.pop_back(); return *this; }
+    JsonWriter &begin_array() { separate(); m_buf += '['; m_first.push_back(true); return *this; }
+    JsonWriter &end_array() { m_buf += ']'; m_first.pop_back(); return *this; }
+
+    JsonWriter &key(const std::string &name)
+    {
+        separate();
+        quoted(name);
+        m_buf += ':';
+        m_after_key = true;
+        return *this;
+    }
+
+    JsonWriter &value(const std::string &data) { separate(); quoted(data); return *this; }
+    JsonWriter &value(const char *data) { return value(std::string(data)); }
+    JsonWriter &value(bool data) { separate(); m_buf += data ? "true" : "false"; return *this; }
+    JsonWriter &null() { separate(); m_buf += "null"; return *this; }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, JsonWriter &>::type
+    value(T data)
+    {
+        separate();
+        m_buf += std::to_string(data);
+        return *this;
+    }
+};
+
+// Minimal JSON reader for request bodies. Numbers are kept as their
+// text, callers convert what they need with cast()
+struct JsonValue
+{
+    enum type_t
+    {
+        NUL = 0,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    type_t type = NUL;
+    bool boolean = false;
+    std::string text = {};      // STRING and NUMBER
+    std::vector<JsonValue> items = {};
+    std::vector<std::pair<std::string, JsonValue>> members = {};
+
+    const JsonValue *find(const std::string &name) const
+    {
+        for (const auto &member : members)
+            if (member.first == name)
+                return &member.second;
+        return nullptr;
+    }
+
+    std::string string(const std::string &name) const
+    {
+        auto value = find(name);
+        return (value && value->type == STRING) ? value->text : "";
+    }
+};
+
+class JsonReader
+{
+private:
+    const std::string &m_data;
+    size_t m_pos = 0;
+    unsigned m_depth = 0;
+    const unsigned m_max_depth = 32;
+
+    void skip()
+    {
+        while (m_pos < m_data.size() && std::isspace(static_cast<unsigned char>(m_data[m_pos])))
+            m_pos++;
+    }
+
+    bool literal(const char *word)
+    {
+        auto len = std::strlen(word);
+        if (m_data.compare(m_pos, len, word) != 0)
+            return false;
+        m_pos += len;
+        return true;
+    }
+
+    size_t digits()
+    {
+        auto start = m_pos;
+        while (m_pos < m_data.size() && std::isdigit(static_cast<unsigned char>(m_data[m_pos])))
+            m_pos++;
+        return m_pos - start;
+    }
+
+    bool peek(char c) const
+    {
+        return m_pos < m_data.size() && m_data[m_pos] == c;
+    }
+
+    // -? (0 | [1-9][0-9]*) (.[0-9]+)? ([eE][+-]?[0-9]+)?
+    bool number(std::string &out)
+    {
+        auto start = m_pos;
+        if (peek('-'))
+            m_pos++;
+        if (peek('0'))
+            m_pos++;
+        else if (!digits())
+            return false;
+        if (peek('.'))
+        {
+            m_pos++;
+            if (!digits())
+                return false;
+        }
+        if (peek('e') || peek('E'))
+        {
+            m_pos++;
+            if (peek('+') || peek('-'))
+                m_pos++;
+            if (!digits())
+                return false;
+        }
+        out = m_data.substr(start, m_pos - start);
+        return true;
+    }
+
+    bool string(std::string &out)
+    {
+        if (m_data[m_pos++] != '"')
+            return false;
+        while (m_pos < m_data.size())
+        {
+            char c = m_data[m_pos++];
+            if (c == '"')
+                return true;
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (m_pos >= m_data.size())
+                return false;
+            switch (m_data[m_pos++])
+            {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/'; break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u':
+                {
+                    // Only the ASCII range is meaningful for our inputs
+                    unsigned code = 0;
+                    if (m_pos + 4 > m_data.size())
+                        return false;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        char h = m_data[m_pos++];
+                        if (!std::isxdigit(static_cast<unsigned char>(h)))
+                            return false;
+                        code = code * 16 + (std::isdigit(static_cast<unsigned char>(h))
+                                                ? h - '0'
+                                                : std::tolower(h) - 'a' + 10);
+                    }
+                    if (code > 0x7f)
+                        return false;
+                    out += static_cast<char>(code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool value(JsonValue &out)
+    {
+        skip();
+        if (m_pos >= m_data.size() || m_depth > m_max_depth)
+            return false;
+
+        char c = m_data[m_pos];
+        if (c == '{' || c == '[')
+        {
+            bool object = (c == '{');
+            out.type = object ? JsonValue::OBJECT : JsonValue::ARRAY;
+            m_pos++;
+            m_depth++;
+            skip();
+            if (m_pos < m_data.size() && m_data[m_pos] == (object ? '}' : ']'))
+            {
+                m_pos++;
+                m_depth--;
+                return true;
+            }
+            while (true)
+            {
+                JsonValue item;
+                if (object)
+                {
+                    std::string name;
+                    skip();
+                    if (m_pos >= m_data.size() || !string(name))
+                        return false;
+                    skip();
+                    if (m_pos >= m_data.size() || m_data[m_pos++] != ':')
+                        return false;
+                    if (!value(item))
+                        return false;
+                    out.members.emplace_back(std::move(name), std::move(item));
+                }
+                else
+                {
+                    if (!value(item))
+                        return false;
+                    out.items.push_back(std::move(item));
+                }
+
+                skip();
+                if (m_pos >= m_data.size())
+                    return false;
+                c = m_data[m_pos++];
+                if (c == (object ? '}' : ']'))
+                {
+                    m_depth--;
+                    return true;
+                }
+                if (c != ',')
+                    return false;
+            }
+        }
+        if (c == '"')
+        {
+            out.type = JsonValue::STRING;
+            return string(out.text);
+        }
+        bool truth = literal("true");
+        if (truth || literal("false"))
+        {
+            out.type = JsonValue::BOOLEAN;
+            out.boolean = truth;
+            return true;
+        }
+        if (literal("null"))
+            return true;
+
+        out.type = JsonValue::NUMBER;
+        return number(out.text);
+    }
+
+public:
+    JsonReader(const std::string &data)
+        : m_data(data)
+    {}
+
+    bool parse(JsonValue &out)
+    {
+        m_pos = 0;
+        m_depth = 0;
+        if (!value(out))
+            return false;
+        skip();
+        return m_pos == m_data.size();
+    }
+};
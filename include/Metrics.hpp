@@ -0,0 +1,119 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <atomic>
+#include <deque>
+
+// Prometheus style metrics. Updates are lock free: every metric keeps
+// one cache line per shard and threads are spread over the shards, so
+// concurrent writers do not contend. Reads sum the shards
+namespace metrics {
+
+const size_t shard_count = 16;
+size_t shard();
+
+using labels_t = std::vector<std::pair<std::string, std::string>>;
+
+class Counter
+{
+private:
+    struct alignas(64) cell_t
+    {
+        std::atomic<uint64_t> value{0};
+    };
+    cell_t m_cells[shard_count];
+
+public:
+    void inc(uint64_t n = 1)
+    {
+        m_cells[shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+};
+
+class Gauge
+{
+private:
+    std::atomic<int64_t> m_value{0};
+
+public:
+    void inc() { m_value.fetch_add(1, std::memory_order_relaxed); }
+    void dec() { m_value.fetch_sub(1, std::memory_order_relaxed); }
+    void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+class Histogram
+{
+public:
+    // Upper bounds in seconds, +Inf is implied
+    static constexpr double bounds[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                        0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+    static constexpr size_t bucket_count = sizeof(bounds) / sizeof(bounds[0]) + 1;
+
+    struct snapshot_t
+    {
+        uint64_t buckets[bucket_count] = {}; // Not cumulative
+        uint64_t count = 0;
+        double sum = 0;                      // Seconds
+    };
+
+private:
+    struct alignas(64) cell_t
+    {
+        std::atomic<uint64_t> buckets[bucket_count] = {};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    cell_t m_cells[shard_count];
+
+public:
+    void observe(std::chrono::nanoseconds elapsed);
+    snapshot_t snapshot() const;
+};
+
+// Registration takes a lock, call sites keep the returned reference
+// (typically in a function local static) to stay lock free
+Counter &counter(const std::string &name, const std::string &help, const labels_t &labels = {});
+Gauge &gauge(const std::string &name, const std::string &help, const labels_t &labels = {});
+Histogram &histogram(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+// Text exposition format (version 0.0.4)
+std::string render();
+
+// Observes the lifetime of the scope
+class Timer
+{
+private:
+    Histogram &m_histogram;
+    const std::chrono::steady_clock::time_point m_start;
+
+public:
+    explicit Timer(Histogram &histogram)
+        : m_histogram(histogram),
+          m_start(std::chrono::steady_clock::now())
+    {}
+    ~Timer()
+    {
+        m_histogram.observe(std::chrono::steady_clock::now() - m_start);
+    }
+};
+
+// Tracks in-flight work for the lifetime of the scope
+class InFlight
+{
+private:
+    Gauge &m_gauge;
+
+public:
+    explicit InFlight(Gauge &gauge)
+        : m_gauge(gauge)
+    {
+        m_gauge.inc();
+    }
+    ~InFlight()
+    {
+        m_gauge.dec();
+    }
+};
+
+} // namespace metrics
@@ -0,0 +1,52 @@
+#pragma once
+#include <dnskeeper.h>
+#include <SingleFlight.hpp>
+
+#include <memory>
+#include <unordered_map>
+
+// Rendered responses keyed by page and by the versions of the data
+// they were built from. A page is served from here until either the
+// DNS zone or the server inventory moves on
+class PageCache
+{
+public: // Types
+    using version_t = std::pair<uint64_t /*zone*/, uint64_t /*inventory*/>;
+    struct page_t
+    {
+        version_t version;
+        std::string etag;   // Strong, quoted content hash
+        std::string body;
+        std::string gzip;   // Empty if compression failed
+        std::string mime;
+    };
+    using page_ptr = std::shared_ptr<const page_t>;
+    using builder_t = std::function<std::string()>;
+
+private:
+    PageCache(const PageCache &) = delete;
+    PageCache operator=(const PageCache &) = delete;
+
+    std::mutex m_mtx;
+    std::unordered_map<std::string, page_ptr> m_pages;
+    SingleFlight<page_ptr> m_builds; // Keyed by page and versions
+
+public:
+    PageCache() = default;
+
+    static bool gzip(const std::string &data, std::string &compressed);
+    static std::string etag(const std::string &data);
+
+    page_ptr find(const std::string &key, const version_t &version);
+    page_ptr store(const std::string &key,
+                   const version_t &version,
+                   std::string body,
+                   const std::string &mime = "text/html");
+
+    // The cached page, or the one the builder makes. Requests missing
+    // the same page and versions at once share a single build
+    page_ptr get(const std::string &key,
+                 const version_t &version,
+                 const builder_t &build,
+                 const std::string &mime = "text/html");
+};
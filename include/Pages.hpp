@@ -0,0 +1,21 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <Display.hpp>
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+// Page builders. They only transform data that was already fetched,
+// fetching, caching and transport are left to the caller
+
+// DNS records with the server each address belongs to
+void build_dns_page(DnsUI &ui,
+                    const DnsHandler::records_t &records,
+                    const SrvCache::records_t &servers,
+                    const std::string &domain_name);
+
+// Servers with their rotation status in DNS
+void build_servers_page(ServerUI &ui,
+                        const DnsHandler::records_t &records,
+                        const SrvCache::records_t &servers,
+                        const std::string &domain_name);
@@ -0,0 +1,126 @@
+#pragma once
+#include <dnskeeper.h>
+#include <IpAddr.hpp>
+
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <condition_variable>
+
+// Health checks every server address from a single thread, with
+// non-blocking connects multiplexed on epoll. An address goes DOWN
+// after `fall` consecutive failed probes and UP after `rise` good
+// ones. DOWN addresses are pulled from DNS through the rotator and
+// restored once UP, never more than `max_pulled` at a time. Only
+// addresses the prober pulled itself are ever restored
+class Prober
+{
+public: // Types
+    enum class check_t
+    {
+        TCP = 0, // Connect only
+        HTTP     // GET, 2xx and 3xx are healthy
+    };
+    enum class state_t
+    {
+        UNKNOWN = 0,
+        UP,
+        DOWN
+    };
+    struct options_t
+    {
+        check_t check = check_t::TCP;
+        uint16_t port = 80;
+        std::string path = "/";                  // HTTP only
+        std::chrono::milliseconds interval = 10s; // Between rounds
+        std::chrono::milliseconds timeout = 2s;   // Per probe
+        unsigned rise = 2;
+        unsigned fall = 3;
+        size_t max_pulled = 1;
+        size_t max_in_flight = 512;              // Open sockets at once
+    };
+
+    // A DNS name and one of its addresses
+    struct target_t
+    {
+        std::string name;
+        IpAddr ip;
+    };
+    using targets_t = std::vector<target_t>;
+
+    // Removal (pull) or re-addition of an address. The rotator sets ok
+    struct rotation_t
+    {
+        std::string name;
+        IpAddr ip;
+        bool pull;
+        bool ok = false;
+    };
+    using rotations_t = std::vector<rotation_t>;
+
+    using source_t = std::function<bool(targets_t &)>;
+    using rotator_t = std::function<void(rotations_t &)>;
+
+    struct status_t
+    {
+        std::string name;
+        IpAddr ip;
+        state_t state = state_t::UNKNOWN;
+        unsigned successes = 0; // Consecutive
+        unsigned failures = 0;  // Consecutive
+        bool pulled = false;
+        bool refused = false;   // Pull refused while DOWN (e.g. not in DNS)
+    };
+
+private:
+    Prober(const Prober &) = delete;
+    Prober operator=(const Prober &) = delete;
+    Prober() = delete;
+
+    using clock_t = std::chrono::steady_clock;
+
+    // One probe in flight, keyed by its socket
+    struct probe_t
+    {
+        size_t target;
+        uint64_t seq;           // Tells a reused fd from the one that timed out
+        bool connected = false; // HTTP: request sent, reading the reply
+        std::string reply;
+    };
+
+    const options_t m_options;
+    source_t m_source;
+    rotator_t m_rotator;
+    std::string m_request; // HTTP request, the same for every target
+
+    std::mutex m_mtx; // Guards m_targets
+    std::vector<status_t> m_targets;
+
+    int m_epoll = -1;
+    std::unordered_map<int, probe_t> m_probes;
+    std::deque<std::tuple<clock_t::time_point, int, uint64_t>> m_deadlines; // In start order
+    uint64_t m_seq = 0;
+
+    std::atomic<uint64_t> m_rounds{0};
+    std::mutex m_stop_mtx;
+    std::condition_variable m_stop_cv;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+
+    void load_targets();
+    void start(size_t target);
+    void handle(int fd, uint32_t events);
+    void finish(int fd, bool healthy);
+    void record(size_t target, bool healthy);
+    void rotate();
+    void probe_loop();
+
+public:
+    Prober(const options_t &options, source_t source, rotator_t rotator);
+    ~Prober();
+
+    static const char *to_string(state_t state);
+
+    std::vector<status_t> status();
+    uint64_t rounds() const { return m_rounds; } // Completed rounds
+};
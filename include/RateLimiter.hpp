@@ -0,0 +1,58 @@
+#pragma once
+#include <dnskeeper.h>
+#include <TokenBucket.hpp>
+
+#include <memory>
+#include <random>
+
+// Request budgets shared by every Route53 call in the process, one
+// for reads (listings, change status) and one for changes, and the
+// retry schedule for calls Route53 asked us to repeat. Backoff uses
+// decorrelated jitter: each delay is drawn between the base and three
+// times the previous delay, capped, so retrying callers spread out
+class RateLimiter
+{
+public:
+    enum class kind_t
+    {
+        READ = 0,
+        CHANGE
+    };
+    struct options_t
+    {
+        double read_rate = 4;    // Requests per second, 0 is unlimited
+        double change_rate = 1;
+        unsigned max_attempts = 6;
+        std::chrono::milliseconds base_delay = 100ms;
+        std::chrono::milliseconds max_delay = 10s;
+    };
+
+private:
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter operator=(const RateLimiter &) = delete;
+
+    std::mutex m_mtx;
+    options_t m_options;
+    std::shared_ptr<TokenBucket> m_read;
+    std::shared_ptr<TokenBucket> m_change;
+    std::mt19937 m_rng;
+
+public:
+    RateLimiter();
+    explicit RateLimiter(const options_t &options);
+
+    // The limiter in front of Route53 unless told otherwise
+    static RateLimiter &process();
+
+    // Replaces the budgets, callers waiting on the old ones are served
+    void configure(const options_t &options);
+    options_t options();
+
+    // Blocks until the budget allows one more call
+    void acquire(kind_t kind);
+
+    // Delay before the next attempt given the previous delay (zero
+    // before the first retry). Decorrelated jitter: uniform between
+    // base_delay and three times the previous delay, capped at max_delay
+    std::chrono::milliseconds backoff(std::chrono::milliseconds previous);
+};
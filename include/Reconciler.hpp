@@ -0,0 +1,81 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+// Desired (inventory) versus published (DNS) addresses, computed in
+// one pass over each side. Record names are interned into integer
+// ids and addresses are compared as IpAddr values, so matching a
+// server is a single probe of a flat hash table without string
+// allocations.
+// Results refer to the inputs by index, the inputs must outlive the
+// Reconciler only while it is being constructed
+class Reconciler
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // One IP of one DNS record
+    struct address_t
+    {
+        size_t record;          // Index in the records
+        size_t ip;              // Index in the record's IP list
+        size_t server = npos;   // First server with this address, see next()
+    };
+
+private:
+    Reconciler(const Reconciler &) = delete;
+    Reconciler operator=(const Reconciler &) = delete;
+    Reconciler() = delete;
+
+    // Open addressing (linear probing) from (name id, address) to
+    // the index of the published address
+    class table_t
+    {
+    public:
+        struct key_t
+        {
+            IpAddr ip;
+            uint32_t name;
+            bool operator==(const key_t &other) const { return name == other.name && ip == other.ip; }
+        };
+
+    private:
+        static constexpr uint32_t empty = static_cast<uint32_t>(-1);
+        std::vector<key_t> m_keys;
+        std::vector<uint32_t> m_values; // empty marks a free slot
+        unsigned m_shift = 64;
+
+        size_t slot(const key_t &key) const;
+
+    public:
+        explicit table_t(size_t count);
+        bool insert(const key_t &key, uint32_t value);
+        bool find(const key_t &key, uint32_t &value) const;
+    };
+
+    std::vector<address_t> m_addresses;
+    std::vector<size_t> m_next;     // Per server: next server with the same address
+    std::vector<bool> m_published;  // Per server
+    size_t m_present = 0;
+    size_t m_extra = 0;
+
+public:
+    Reconciler(const DnsHandler::records_t &records,
+               const SrvCache::records_t &servers,
+               const std::string &domain_name);
+
+    // Published addresses in record order
+    const std::vector<address_t> &addresses() const { return m_addresses; }
+
+    // Servers sharing an address are chained, npos ends the chain
+    size_t next(size_t server) const { return m_next[server]; }
+
+    // Is the server address published on <subdomain>.<domain_name>
+    bool published(size_t server) const { return m_published[server]; }
+
+    size_t present() const { return m_present; }                      // Servers in DNS
+    size_t missing() const { return m_published.size() - m_present; } // Servers not in DNS
+    size_t extra() const { return m_extra; }                          // Addresses without a server
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <dnskeeper.h>
+#include <DnsProvider.hpp>
+
+#include <map>
+#include <random>
+
+// In-process stand-in for Route53 hosted zones. It keeps
+// Route53's semantics that dnskeeper relies on (paged listings,
+// atomic and validated change batches, PENDING then INSYNC changes)
+// and can inject latency and throttling to find throughput limits
+// without touching AWS
+class Route53Emulator : public DnsProvider
+{
+public:
+    struct options_t
+    {
+        std::string domain;                              // Hosted zone name
+        std::chrono::milliseconds latency = 0ms;         // Added to every call
+        std::chrono::milliseconds jitter = 0ms;          // Uniform, on top of the latency
+        double throttle_rate = 0;                        // Share of calls failing with Throttling
+        std::chrono::milliseconds insync_delay = 0ms;    // Time a change stays PENDING
+        size_t max_items = 300;                          // Listing page size (as Route53)
+        std::vector<std::string> private_zones = {};     // Extra zones, ids Z1EMULATED...
+    };
+
+    static const std::string zone_id; // The domain's zone
+
+    // Route53 orders names by their labels from the right, so
+    // www.example.com sorts as com, example, www and a subtree is
+    // listed without gaps. Returns <0, 0 or >0 like strcmp
+    static int compare_names(const std::string &a, const std::string &b);
+
+private:
+    Route53Emulator(const Route53Emulator &) = delete;
+    Route53Emulator operator=(const Route53Emulator &) = delete;
+    Route53Emulator() = delete;
+
+    using key_t = std::pair<std::string, Model::RRType>;
+    struct listing_order
+    {
+        bool operator()(const key_t &a, const key_t &b) const
+        {
+            int c = compare_names(a.first, b.first);
+            return c < 0 || (c == 0 && a.second < b.second);
+        }
+    };
+    using rrsets_t = std::map<key_t, Model::ResourceRecordSet, listing_order>;
+    struct zone_t
+    {
+        std::string name; // FQDN
+        bool private_zone;
+        rrsets_t rrsets;
+    };
+
+    const options_t m_options;
+    std::mutex m_mtx;
+    std::map<std::string, zone_t> m_zones; // By zone id
+    std::map<std::string, std::chrono::steady_clock::time_point> m_changes; // Id -> INSYNC time
+    uint64_t m_next_change = 1;
+    size_t m_change_calls = 0;
+    size_t m_in_flight = 0;
+    size_t m_max_in_flight = 0;
+    std::mt19937 m_rng;
+
+    // Latency and throttling common to every call
+    bool throttled();
+
+public:
+    explicit Route53Emulator(const options_t &options);
+
+    // Number of record sets across all zones
+    size_t size();
+
+    // ChangeResourceRecordSets calls received, accepted or not
+    size_t change_calls();
+
+    // Most calls seen waiting out their latency at the same time since
+    // the previous call to this
+    size_t max_in_flight();
+
+    Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request) override;
+
+    Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request) override;
+
+    Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request) override;
+
+    Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &request) override;
+};
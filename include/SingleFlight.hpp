@@ -0,0 +1,68 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <future>
+#include <unordered_map>
+
+// Coalesces concurrent identical work. The first caller for a key runs
+// the computation, callers arriving while it runs wait for it and get
+// a copy of the same result. Nothing is cached: a call made after the
+// computation finished starts a new one. Exceptions reach every caller
+template <typename Value>
+class SingleFlight
+{
+private:
+    SingleFlight(const SingleFlight &) = delete;
+    SingleFlight operator=(const SingleFlight &) = delete;
+
+    std::mutex m_mtx;
+    std::unordered_map<std::string, std::shared_future<Value>> m_calls;
+
+public:
+    SingleFlight() = default;
+
+    // shared, if given, tells whether the result came from another caller
+    template <typename F>
+    Value run(const std::string &key, F &&compute, bool *shared = nullptr)
+    {
+        std::shared_future<Value> call;
+        std::promise<Value> promise;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            auto it = m_calls.find(key);
+            if (it != m_calls.end())
+                call = it->second;
+            else
+                m_calls.emplace(key, promise.get_future().share());
+        }
+        if (shared)
+            *shared = call.valid();
+        if (call.valid())
+            return call.get();
+
+        // Later callers start afresh as soon as the result is out
+        try {
+            Value value = compute();
+            forget(key);
+            promise.set_value(value);
+            return value;
+        } catch (...) {
+            forget(key);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    size_t in_flight()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_calls.size();
+    }
+
+private:
+    void forget(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_calls.erase(key);
+    }
+};
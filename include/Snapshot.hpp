@@ -0,0 +1,27 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+// Compact binary copy of the zone records and the server inventory.
+// It is saved while the process runs and mapped at the next start, so
+// pages are served before Route53 and the database have answered. The
+// file is replaced atomically and carries a checksum: a torn or foreign
+// file, or one written for another domain, is rejected as a whole
+namespace snapshot {
+
+struct data_t
+{
+    std::chrono::system_clock::time_point saved = {};
+    DnsHandler::records_t records;
+    std::map<long, SrvCache::row_t> servers; // Keyed by server id
+};
+
+bool save(const std::string &path,
+          const std::string &domain,
+          const DnsHandler::zone_t &zone,
+          const SrvCache::inventory_t &inventory);
+bool load(const std::string &path, const std::string &domain, data_t &data);
+
+} // namespace snapshot
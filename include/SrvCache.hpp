@@ -1,15 +1,16 @@
 #pragma once
 #include <dnskeeper.h>
 
-#include <pqxx/pqxx>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <condition_variable>
+#include <ConnPool.hpp>
+#include <IpAddr.hpp>
+#include <SingleFlight.hpp>
+
 class SrvCache
 {
-private:
-    pqxx::connection m_conn;
-    SrvCache(const SrvCache &) = delete;
-    SrvCache operator=(const SrvCache &) = delete;
-    SrvCache() = delete;
-
 public:
     enum rowspec
     {
@@ -21,15 +22,72 @@ public:
         SUBDOMAIN,
         MAX_COLS
     };
-    using server_t = std::tuple<std::string /*subdomain*/,
-                                std::string /*IP*/>;
-    using serverlist_t = std::vector<server_t>;
     using row_t = std::vector<std::string>;
     using records_t = std::vector<row_t>;
 
-    SrvCache(const std::string&);
+    // In-process copy of the server inventory. Updates publish a new
+    // inventory_t, readers holding an inventory_ptr are not affected
+    using index_t = std::unordered_map<std::string, std::vector<long> /*server ids*/>;
+    using ip_index_t = std::unordered_map<IpAddr, std::vector<long> /*server ids*/>;
+    struct inventory_t
+    {
+        uint64_t version = 0;
+        bool stale = false;            // Saved by an earlier run, not yet reloaded
+        std::map<long, row_t> servers; // Keyed by server id
+        index_t by_subdomain;
+        ip_index_t by_ip;              // Servers with a valid address
+        index_t by_cluster;            // Cluster id
+        index_t by_key;                // server_key(subdomain, ip)
+
+        void reindex();
+    };
+    using inventory_ptr = std::shared_ptr<const inventory_t>;
+
+private:
+    std::string m_url;
+    ConnPool m_pool;
+    SrvCache(const SrvCache &) = delete;
+    SrvCache operator=(const SrvCache &) = delete;
+    SrvCache() = delete;
+
+    // Inventory kept current by LISTEN/NOTIFY on a dedicated connection
+    std::mutex m_inventory_mtx;
+    inventory_ptr m_inventory;
+    std::mutex m_listen_mtx;
+    std::condition_variable m_listen_cv;
+    bool m_stop = false;
+    std::thread m_listener;
+
+    // Identical queries in flight at once go to the database once
+    SingleFlight<std::pair<bool, records_t>> m_queries;
+
+    template <typename F>
+    bool with_connection(const char *name, F &&query);
+
+    bool install_notify();
+    bool reload();
+    bool apply_change(const std::string &payload);
+    void publish(std::shared_ptr<inventory_t> inventory);
+    void listen_loop();
+
+public:
+    static std::string subdomain_of(const std::string &domain);
+    static std::string server_key(const std::string &subdomain, const std::string &ip);
+
+    SrvCache(const std::string&,
+             size_t pool_size = 4,
+             std::chrono::milliseconds pool_timeout = 5s,
+             bool listen = true);
+    ~SrvCache();
+
+    inventory_ptr inventory();
+
+    // Serves a saved inventory until the first load from the database.
+    // False if that load already happened
+    bool seed(const std::map<long, row_t> &servers);
+    uint64_t version();
     bool test_connection();
     bool get_clusters(records_t &data);
     bool get_servers(records_t &data, const std::string domain = "", const std::string ip = "");
     bool get_subdomains(const row_t &subdomains, records_t &data);
-};
\ No newline at end of file
+};
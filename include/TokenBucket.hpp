@@ -0,0 +1,35 @@
+#pragma once
+#include <dnskeeper.h>
+
+// Request budget refilled at a steady rate. acquire() reserves a
+// token and sleeps until it is due, so concurrent callers are served
+// in arrival order and never exceed rate (plus the initial burst)
+class TokenBucket
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+private:
+    TokenBucket(const TokenBucket &) = delete;
+    TokenBucket operator=(const TokenBucket &) = delete;
+    TokenBucket() = delete;
+
+    const double m_rate;  // Tokens per second, 0 is unlimited
+    const double m_burst; // Bucket capacity
+    std::mutex m_mtx;
+    double m_tokens;      // Negative while callers wait for reserved tokens
+    clock_t::time_point m_updated;
+
+    void refill(clock_t::time_point now);
+
+public:
+    TokenBucket(double rate, double burst);
+
+    // Blocks until a token is available. Returns the time spent waiting
+    clock_t::duration acquire();
+
+    // Takes a token only if one is available right now
+    bool try_acquire();
+
+    double rate() const { return m_rate; }
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <dnskeeper.h>
+
+#include <future>
+#include <condition_variable>
+
+// Collects operations over a short window and hands them to the
+// applier as a single batch. Every submitter gets back its own
+// operation with the result filled in by the applier
+template <typename Op>
+class WriteQueue
+{
+public: // Types
+    using ops_t = std::vector<Op>;
+    using applier_t = std::function<void(ops_t &)>;
+
+private:
+    WriteQueue(const WriteQueue &) = delete;
+    WriteQueue operator=(const WriteQueue &) = delete;
+    WriteQueue() = delete;
+
+    applier_t m_applier;
+    const std::chrono::milliseconds m_window;
+    const size_t m_max_batch;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    ops_t m_ops;
+    std::vector<std::promise<Op>> m_promises;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    void flush_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        while (true)
+        {
+            m_cv.wait(lock, [this] { return m_stop || !m_ops.empty(); });
+            if (m_ops.empty())
+                return; // Stopped and drained
+
+            // Let the window fill up unless the batch is already full
+            m_cv.wait_for(lock, m_window, [this] {
+                return m_stop || m_ops.size() >= m_max_batch;
+            });
+
+            ops_t ops;
+            std::vector<std::promise<Op>> promises;
+            ops.swap(m_ops);
+            promises.swap(m_promises);
+            lock.unlock();
+
+            LOG(TRACE) << "Write queue flushing " << ops.size() << " operations\n";
+            try {
+                m_applier(ops);
+            } catch(std::exception &x) {
+                LOG(ERROR) << "Write queue batch failed: " << x.what() << "\n";
+            }
+
+            for (size_t i = 0; i < ops.size(); i++)
+                promises[i].set_value(std::move(ops[i]));
+            lock.lock();
+        }
+    }
+
+public:
+    WriteQueue(applier_t applier,
+               std::chrono::milliseconds window = 50ms,
+               size_t max_batch = 500)
+        : m_applier(applier),
+          m_window(window),
+          m_max_batch(max_batch)
+    {
+        m_thread = std::thread(&WriteQueue::flush_loop, this);
+    }
+
+    ~WriteQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    std::future<Op> submit(Op op)
+    {
+        std::promise<Op> promise;
+        auto result = promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_ops.push_back(std::move(op));
+            m_promises.push_back(std::move(promise));
+        }
+        m_cv.notify_all();
+        return result;
+    }
+};
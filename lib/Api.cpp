@@ -0,0 +1,239 @@
+#include <dnskeeper.h>
+#include <Api.hpp>
+
+#include <set>
+
+namespace {
+
+using iplist_t = DnsHandler::iplist_t;
+
+const char *type_name(Model::RRType type)
+{
+    switch (type)
+    {
+        case Model::RRType::A:
+            return "A";
+        case Model::RRType::AAAA:
+            return "AAAA";
+        default:
+            return "";
+    }
+}
+
+} // anonymous namespace (private)
+
+namespace api {
+
+bool stream_records(const DnsHandler::snapshot_t &zone,
+                    const SrvCache::inventory_ptr &inventory,
+                    const query_t &query,
+                    JsonWriter::sink_t sink)
+{
+    // A cluster maps onto the subdomains its servers live in
+    std::set<std::string> subdomains;
+    if (!query.cluster.empty() && inventory)
+        for (const auto &entry : inventory->servers)
+            if (entry.second[SrvCache::CLUSTER_NAME] == query.cluster)
+                subdomains.insert(entry.second[SrvCache::SUBDOMAIN]);
+
+    // Addresses are compared by value, not by text
+    IpAddr ip;
+    bool by_ip = !query.ip.empty();
+    bool valid_ip = by_ip && IpAddr::parse(query.ip, ip);
+
+    JsonWriter json(sink);
+    json.begin_object()
+        .key("version").value(zone->version)
+        .key("items").begin_array();
+
+    // Records are ordered by FQDN then type, the cursor is the last
+    // name served. The A and AAAA records of a name share a page
+    size_t count = 0;
+    std::string last;
+    auto it = zone->rrsets.begin();
+    if (!query.cursor.empty())
+    {
+        it = zone->rrsets.lower_bound({query.cursor + ".", Model::RRType::NOT_SET});
+        while (it != zone->rrsets.end() && it->first.first == query.cursor + ".")
+            ++it;
+    }
+    iplist_t ips;
+    for (; it != zone->rrsets.end() && json.ok(); ++it)
+    {
+        const auto &rrs = it->second;
+        const auto &fqdn = it->first.first;
+        auto name = fqdn.substr(0, fqdn.size() - 1);
+        auto subdomain = SrvCache::subdomain_of(name);
+        if (!query.subdomain.empty() && subdomain != query.subdomain)
+            continue;
+        if (!query.cluster.empty() && !subdomains.count(subdomain))
+            continue;
+
+        ips.clear();
+        for (const auto &rr : rrs.GetResourceRecords())
+        {
+            IpAddr value;
+            if (IpAddr::parse(rr.GetValue(), value))
+                ips.push_back(value);
+        }
+        if (by_ip && (!valid_ip || std::find(ips.begin(), ips.end(), ip) == ips.end()))
+            continue;
+
+        if (count >= query.limit && name != last)
+            break;
+
+        json.begin_object()
+            .key("name").value(name)
+            .key("ttl").value(static_cast<long long>(rrs.GetTTL()))
+            .key("type").value(type_name(rrs.GetType()))
+            .key("ips").begin_array();
+        for (const auto &value : ips)
+            json.value(value.to_string());
+        json.end_array().end_object();
+
+        last = name;
+        count++;
+    }
+
+    json.end_array().key("next_cursor");
+    if (it != zone->rrsets.end())
+        json.value(last);
+    else
+        json.null();
+    json.end_object();
+    return json.flush();
+}
+
+bool stream_servers(const SrvCache::inventory_ptr &inventory,
+                    const query_t &query,
+                    JsonWriter::sink_t sink)
+{
+    JsonWriter json(sink);
+    json.begin_object()
+        .key("version").value(inventory->version)
+        .key("items").begin_array();
+
+    // Servers are ordered by id, the cursor is the last id served
+    long cursor = 0;
+    auto it = inventory->servers.begin();
+    if (!query.cursor.empty() && cast(query.cursor, cursor))
+        it = inventory->servers.upper_bound(cursor);
+
+    // Inventory addresses are canonical text
+    std::string ip = query.ip;
+    IpAddr addr;
+    if (IpAddr::parse(query.ip, addr))
+        ip = addr.to_string();
+
+    size_t count = 0;
+    for (; it != inventory->servers.end() && json.ok(); ++it)
+    {
+        const auto &row = it->second;
+        if ((!query.subdomain.empty() && row[SrvCache::SUBDOMAIN] != query.subdomain)
+            || (!query.cluster.empty() && row[SrvCache::CLUSTER_NAME] != query.cluster)
+            || (!ip.empty() && row[SrvCache::IP_ADDR] != ip))
+            continue;
+
+        if (count == query.limit)
+            break;
+
+        long cluster_id = 0;
+        cast(row[SrvCache::CLUSTER_ID], cluster_id);
+        json.begin_object()
+            .key("id").value(it->first)
+            .key("ip").value(row[SrvCache::IP_ADDR])
+            .key("name").value(row[SrvCache::NAME])
+            .key("cluster_id").value(cluster_id)
+            .key("cluster").value(row[SrvCache::CLUSTER_NAME])
+            .key("subdomain").value(row[SrvCache::SUBDOMAIN])
+            .end_object();
+
+        cursor = it->first;
+        count++;
+    }
+
+    json.end_array().key("next_cursor");
+    if (it != inventory->servers.end())
+        json.value(std::to_string(cursor));
+    else
+        json.null();
+    json.end_object();
+    return json.flush();
+}
+
+bool parse_mutations(const std::string &body,
+                     DnsHandler::mutations_t &ops,
+                     std::string &error)
+{
+    JsonValue doc;
+    if (!JsonReader(body).parse(doc))
+    {
+        error = "malformed JSON";
+        return false;
+    }
+
+    const JsonValue *list = &doc;
+    if (doc.type == JsonValue::OBJECT)
+        list = doc.find("operations");
+    if (!list || list->type != JsonValue::ARRAY)
+    {
+        error = "expected a list of operations";
+        return false;
+    }
+    if (list->items.size() > max_operations)
+    {
+        error = "too many operations";
+        return false;
+    }
+
+    for (const auto &item : list->items)
+    {
+        DnsHandler::mutation_t op;
+        op.name = item.string("domain");
+        op.ip = item.string("ip");
+        auto action = item.string("action");
+        if (action == "add")
+            op.action = DnsHandler::action_t::ADD;
+        else if (action == "remove")
+            op.action = DnsHandler::action_t::REMOVE;
+        else
+        {
+            error = "unknown action [" + action + "]";
+            return false;
+        }
+
+        if (op.name.empty() || op.ip.empty())
+        {
+            error = "operations need a domain and an ip";
+            return false;
+        }
+        ops.push_back(op);
+    }
+    return true;
+}
+
+bool write_results(const DnsHandler::mutations_t &ops,
+                   JsonWriter::sink_t sink)
+{
+    JsonWriter json(sink);
+    json.begin_object()
+        .key("ok").value(std::all_of(ops.begin(), ops.end(),
+                                     [](const auto &op) { return op.ok; }))
+        .key("results").begin_array();
+    for (const auto &op : ops)
+    {
+        json.begin_object()
+            .key("domain").value(op.name)
+            .key("ip").value(op.ip)
+            .key("action").value(op.action == DnsHandler::action_t::ADD ? "add" : "remove")
+            .key("ok").value(op.ok)
+            .key("change_id").value(op.change_id);
+        if (!op.error.empty())
+            json.key("error").value(op.error);
+        json.end_object();
+    }
+    json.end_array().end_object();
+    return json.flush();
+}
+
+} // namespace api
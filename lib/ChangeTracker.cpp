@@ -0,0 +1,177 @@
+#include <dnskeeper.h>
+#include <ChangeTracker.hpp>
+
+ChangeTracker::ChangeTracker(poller_t poller, std::chrono::seconds timeout)
+    : m_poller(poller),
+      m_timeout(timeout)
+{
+    m_thread = std::thread(&ChangeTracker::poll_loop, this);
+}
+
+ChangeTracker::~ChangeTracker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+const char *ChangeTracker::to_string(status_t status)
+{
+    switch (status)
+    {
+        case status_t::PENDING:
+            return "PENDING";
+        case status_t::INSYNC:
+            return "INSYNC";
+        case status_t::FAILED:
+            return "FAILED";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+std::string ChangeTracker::track(const std::string &id, callback_t cb)
+{
+    // AWS replies with a "/change/" prefix that
+    // subsequent API calls dont seem to want
+    auto handle = id.substr(id.rfind("/") + 1);
+    if (handle.empty())
+        return handle;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto now = clock_t::now();
+        auto &chg = m_changes[handle];
+        chg.submitted = now;
+        chg.next_poll = now + m_min_backoff;
+        chg.backoff = m_min_backoff;
+        if (cb)
+            chg.callbacks.push_back(cb);
+    }
+    m_cv.notify_all();
+
+    LOG(TRACE) << "Tracking change " << handle << "\n";
+    return handle;
+}
+
+ChangeTracker::status_t ChangeTracker::status(const std::string &id)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_changes.find(id);
+    return it == m_changes.end() ? status_t::UNKNOWN : it->second.status;
+}
+
+ChangeTracker::status_t ChangeTracker::wait(const std::string &id, std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    status_t result = status_t::UNKNOWN;
+    m_done_cv.wait_for(lock, timeout, [&] {
+        auto it = m_changes.find(id);
+        result = it == m_changes.end() ? status_t::UNKNOWN : it->second.status;
+        return result != status_t::PENDING;
+    });
+    return result;
+}
+
+size_t ChangeTracker::pending()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return std::count_if(m_changes.begin(), m_changes.end(),
+        [](const auto &entry) {
+            return entry.second.status == status_t::PENDING;
+        });
+}
+
+void ChangeTracker::poll_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (!m_stop)
+    {
+        // Sleep until the earliest outstanding poll is due
+        auto now = clock_t::now();
+        auto wake = now + m_retention;
+        std::vector<std::string> due;
+        for (auto it = m_changes.begin(); it != m_changes.end();)
+        {
+            auto &chg = it->second;
+            if (chg.status != status_t::PENDING)
+            {
+                if (now - chg.completed > m_retention)
+                    it = m_changes.erase(it);
+                else
+                    ++it;
+                continue;
+            }
+
+            if (chg.next_poll <= now)
+                due.push_back(it->first);
+            else
+                wake = std::min(wake, chg.next_poll);
+            ++it;
+        }
+
+        if (due.empty())
+        {
+            m_cv.wait_until(lock, wake);
+            continue;
+        }
+
+        // Poll without holding the lock (AWS round trips)
+        lock.unlock();
+        std::vector<std::pair<std::string, bool>> polled;
+        for (const auto &id : due)
+        {
+            bool insync = false;
+            if (m_poller(id, insync))
+                polled.emplace_back(id, insync);
+            else
+                polled.emplace_back(id, false);
+        }
+        lock.lock();
+
+        std::vector<std::pair<callback_t, std::pair<std::string, status_t>>> fired;
+        bool completed = false;
+        now = clock_t::now();
+        for (const auto &result : polled)
+        {
+            auto it = m_changes.find(result.first);
+            if (it == m_changes.end())
+                continue;
+
+            auto &chg = it->second;
+            if (result.second)
+                chg.status = status_t::INSYNC;
+            else if (now - chg.submitted > m_timeout)
+            {
+                LOG(ERROR) << "Change " << result.first << " did not synchronize\n";
+                chg.status = status_t::FAILED;
+            }
+            else
+            {
+                LOG(TRACE) << "Awaiting record syncronization (" << result.first << ") ...\n";
+                chg.backoff = std::min(chg.backoff * 2, m_max_backoff);
+                chg.next_poll = now + chg.backoff;
+                continue;
+            }
+
+            completed = true;
+            chg.completed = now;
+            for (auto &cb : chg.callbacks)
+                fired.push_back({cb, {result.first, chg.status}});
+            chg.callbacks.clear();
+        }
+
+        if (completed)
+        {
+            lock.unlock();
+            m_done_cv.notify_all();
+            for (auto &cb : fired)
+                cb.first(cb.second.first, cb.second.second);
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#include <dnskeeper.h>
+#include <ConnPool.hpp>
+
+ConnPool::ConnPool(const std::string &url,
+                   size_t max_size,
+                   std::chrono::milliseconds timeout,
+                   init_t init)
+    : m_url(url),
+      m_max_size(std::max<size_t>(1, max_size)),
+      m_timeout(timeout),
+      m_init(init)
+{
+}
+
+ConnPool::conn_t ConnPool::connect()
+{
+    try {
+        auto conn = std::make_unique<pqxx::connection>(m_url);
+        if (conn->is_open())
+        {
+            if (m_init)
+                m_init(*conn);
+            return conn;
+        }
+    } catch(const pqxx::failure &x) {
+        LOG(ERROR) << "Database connection failed: " << x.what() << "\n";
+    }
+    return nullptr;
+}
+
+ConnPool::handle_t ConnPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (!m_cv.wait_for(lock, m_timeout, [this] {
+            return !m_idle.empty() || m_open < m_max_size;
+        }))
+    {
+        LOG(WARNING) << "Database pool exhausted (" << m_open << " connections)\n";
+        return handle_t();
+    }
+
+    if (!m_idle.empty())
+    {
+        auto conn = std::move(m_idle.back());
+        m_idle.pop_back();
+        if (conn->is_open())
+            return handle_t(this, std::move(conn));
+
+        // Dropped by the server while idle. Replace it below
+        LOG(NOTICE) << "Discarding closed database connection\n";
+        m_open--;
+    }
+
+    // Connect without holding the lock, the slot is reserved
+    m_open++;
+    lock.unlock();
+    auto conn = connect();
+    if (conn)
+        return handle_t(this, std::move(conn));
+
+    lock.lock();
+    m_open--;
+    lock.unlock();
+    m_cv.notify_one();
+    return handle_t();
+}
+
+void ConnPool::release(conn_t conn, bool broken)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (broken || !conn->is_open())
+        {
+            LOG(NOTICE) << "Closing broken database connection\n";
+            m_open--;
+        }
+        else
+            m_idle.push_back(std::move(conn));
+    }
+    m_cv.notify_one();
+}
+
+size_t ConnPool::size()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_open;
+}
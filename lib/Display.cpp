@@ -1,4 +1,5 @@
 #include <Display.hpp>
+#include <IpAddr.hpp>
 #include <fmt/core.h>
 
 // Validation ref: https://docs.microsoft.com/en-us/troubleshoot/windows-server/identity/naming-conventions-for-computer-domain-site-ou
@@ -24,11 +25,8 @@ bool ServerUI::valid_domain(const std::string& data) {
 }
 
 bool ServerUI::valid_ip(const std::string& data) {
-    return std::all_of(data.begin(), data.end(),
-            [](char c) {
-                return std::isdigit(c)
-                    || c == '.';
-            }) && data.length() <= 15; // ###:###:###:### (assumption: we dont do IPv6)
+    // Strict IPv4 or IPv6 (no zone index, so nothing to escape)
+    return IpAddr::valid(data);
 }
 
 void ServerUI::add_row(const std::string& name, 
@@ -1,110 +1,631 @@
 #include <dnskeeper.h>
 
 #include <DnsHandler.hpp>
-#include <unistd.h>
+#include <Metrics.hpp>
 
 #include <aws/route53/model/ListResourceRecordSetsRequest.h>
 #include <aws/route53/model/ListHostedZonesByNameRequest.h>
 #include <aws/route53/model/GetChangeRequest.h>
 
-DnsHandler::DnsHandler(const std::string& domain)
-    : m_domain(domain)
+#include <future>
+
+namespace {
+
+DnsHandler::row_t to_row(const DnsHandler::rrset_t &r)
+{
+    DnsHandler::iplist_t ips;
+    ips.reserve(r.GetResourceRecords().size());
+    for (const auto &rr : r.GetResourceRecords())
+    {
+        IpAddr ip;
+        if (IpAddr::parse(rr.GetValue(), ip))
+            ips.push_back(ip);
+        else
+            LOG(WARNING) << "Ignoring invalid address [" << rr.GetValue()
+                         << "] in " << r.GetName() << "\n";
+    }
+
+    // AWS API oddity. There's a period
+    // at the end of the returned domain
+    std::string domain = r.GetName();
+    if (!domain.empty() && domain.back() == '.')
+        domain.pop_back();
+    return std::make_tuple(domain,
+                           ips,
+                           r.GetTTL(),
+                           static_cast<char>(r.GetType()));
+}
+
+// Failures of one Route53 API call, once retries are exhausted. The
+// latency of each attempt is recorded by LimitedProvider
+struct route53_call_t
+{
+    metrics::Counter &errors;
+
+    explicit route53_call_t(const char *call)
+        : errors(metrics::counter("dnskeeper_route53_errors_total",
+                                  "Failed Route53 API calls",
+                                  {{"call", call}}))
+    {}
+
+    template <typename F>
+    auto operator()(F &&request) const
+    {
+        auto outcome = request();
+        if (!outcome.IsSuccess())
+            errors.inc();
+        return outcome;
+    }
+
+    // Calls against a zone wait for its budget first
+    template <typename F>
+    auto operator()(const DnsHandler::hosted_zone_t &hz, F &&request) const
+    {
+        if (hz.budget)
+            hz.budget->acquire();
+        return (*this)(std::forward<F>(request));
+    }
+};
+
+std::string fqdn(std::string name)
+{
+    if (name.empty() || name.back() != '.')
+        name += '.';
+    return name;
+}
+
+// True if name is the zone apex or below it. Both are FQDNs
+bool in_zone(const std::string &name, const std::string &zone)
+{
+    return name.size() >= zone.size()
+           && name.compare(name.size() - zone.size(), zone.size(), zone) == 0
+           && (name.size() == zone.size() || name[name.size() - zone.size() - 1] == '.');
+}
+
+// Workers for the asynchronous calls. Route53 takes a few requests per
+// second, more workers would only wait on the rate limiter
+const size_t async_workers = 4;
+
+template <typename T>
+std::future<T> ready(T value)
+{
+    std::promise<T> promise;
+    promise.set_value(std::move(value));
+    return promise.get_future();
+}
+
+// Route53 ChangeBatch limits. UPSERT counts each value twice
+const size_t max_batch_records = 1000;
+const size_t max_batch_chars = 32000;
+
+} // anonymous namespace
+
+DnsHandler::DnsHandler(const std::string& domain,
+                       std::chrono::seconds refresh_interval,
+                       std::chrono::milliseconds write_window,
+                       double zone_rate,
+                       std::shared_ptr<DnsProvider> provider,
+                       snapshot_t seed)
+    : m_domain(domain),
+      m_zone_rate(zone_rate),
+      m_client(provider),
+      m_refresh_interval(refresh_interval)
 {
     Aws::InitAPI(m_options);
-    Aws::Client::ClientConfiguration client_config("default");
-    m_client = Aws::MakeShared<Aws::Route53::Route53Client>("RouteClient");
-    get_hosted_zone();
+    if (!m_client)
+        m_client = std::make_shared<Route53Provider>();
+    m_client = std::make_shared<LimitedProvider>(m_client);
+
+    m_tracker = std::make_unique<ChangeTracker>(
+        [this](const std::string &id, bool &insync) {
+            static const route53_call_t get_change("GetChange");
+            auto outcome = get_change([&] {
+                return m_client->GetChange(Model::GetChangeRequest().WithId(id));
+            });
+            if (!outcome.IsSuccess())
+            {
+                LOG(ERROR) << "GetChange failed: "
+                           << static_cast<int>(outcome.GetError().GetErrorType())
+                           << std::endl
+                           << outcome.GetError()
+                           << std::endl;
+                return false;
+            }
+            auto ci = outcome.GetResult().GetChangeInfo();
+            insync = ci.GetStatus() == Model::ChangeStatus::INSYNC;
+            return true;
+        });
+
+    m_executor = std::make_unique<Executor>(async_workers);
+
+    m_queue = std::make_unique<WriteQueue<mutation_t>>(
+        [this](mutations_t &ops) { apply(ops); },
+        write_window);
+
+    // Prime the snapshot so the first page load is served from memory.
+    // A seed is served right away: the zones are discovered and listed
+    // by the refresher, off the startup path
+    if (seed)
+    {
+        auto zone = std::make_shared<zone_t>(*seed);
+        zone->version = 1;
+        zone->stale = true;
+        m_snapshot = zone;
+    }
+    else
+        refresh();
+    m_refresher = std::thread(&DnsHandler::refresh_loop, this);
 }
 
-std::string DnsHandler::get_hosted_zone()
+DnsHandler::~DnsHandler()
 {
-    if (!m_zone_id.empty())
-        return m_zone_id;
-    auto hzr = Model::ListHostedZonesByNameRequest();
-    hzr.AddQueryStringParameters(m_domain);
-    auto outcome = m_client->ListHostedZonesByName(hzr);
-    if (outcome.IsSuccess())
+    // Queued asynchronous calls and writes finish while everything is
+    // still up
+    m_executor.reset();
+    m_queue.reset();
+
     {
-        auto result = outcome.GetResult();
-        auto zones = result.GetHostedZones();
-        if (zones.size() > 0)
+        std::lock_guard<std::mutex> lock(m_refresh_mtx);
+        m_stop = true;
+    }
+    m_refresh_cv.notify_all();
+    if (m_refresher.joinable())
+        m_refresher.join();
+}
+
+bool DnsHandler::discover()
+{
+    if (m_discovered)
+        return true;
+    std::lock_guard<std::mutex> lock(m_zones_mtx);
+    if (m_discovered)
+        return true;
+
+    // Every zone at or below the domain is ours. Route53 orders
+    // hosted zones by reversed labels (then id), so they follow
+    // the domain's own zone and the listing starts there
+    const auto domain = fqdn(m_domain);
+    static const route53_call_t list_zones("ListHostedZonesByName");
+    auto hzr = Model::ListHostedZonesByNameRequest().WithDNSName(domain);
+    std::vector<hosted_zone_t> found;
+    for (;;)
+    {
+        auto outcome = list_zones([&] { return m_client->ListHostedZonesByName(hzr); });
+        if (!outcome.IsSuccess())
+        {
+            LOG(ERROR) << "ListHostedZones: "
+                       << outcome.GetError()
+                       << std::endl;
+            return false;
+        }
+
+        const auto &result = outcome.GetResult();
+        for (const auto &zone : result.GetHostedZones())
         {
-            // Note: Right now we just use the first one for the test
-            m_zone_id = zones[0].GetId();
+            auto name = fqdn(zone.GetName());
+            if (!in_zone(name, domain))
+                continue;
 
             // AWS api replies with a zone_id
             // with a prefix that subsequent API
             // calls dont seem to want
-            m_zone_id = m_zone_id.substr(m_zone_id.rfind("/") + 1);
-            LOG(DEBUG) << "DNS Zone ID: " << m_zone_id << "\n";
-        }
-        else
-        {
-            LOG(FATAL) << "No zone found\n";
-            exit(-1);
+            auto id = zone.GetId();
+            id = id.substr(id.rfind("/") + 1);
+
+            // Writes are routed by name, so a name can only have
+            // one zone (split-horizon duplicates are not managed)
+            auto dup = std::find_if(found.begin(), found.end(),
+                                    [&](const auto &hz) { return hz.name == name; });
+            if (dup != found.end())
+            {
+                LOG(WARNING) << "Ignoring hosted zone " << id << ", " << name
+                             << " is already managed in " << dup->id << "\n";
+                continue;
+            }
+
+            hosted_zone_t hz;
+            hz.id = id;
+            hz.name = name;
+            hz.private_zone = zone.GetConfig().GetPrivateZone();
+            hz.budget = std::make_shared<TokenBucket>(m_zone_rate, m_zone_rate);
+            LOG(DEBUG) << "DNS Zone ID: " << hz.id << " (" << hz.name
+                       << (hz.private_zone ? ", private" : "") << ")\n";
+            found.push_back(hz);
         }
+
+        // Past the domain's zones, the rest of the account is not ours
+        const auto &zones = result.GetHostedZones();
+        if (!result.GetIsTruncated()
+            || (!zones.empty() && !found.empty()
+                && !in_zone(fqdn(zones.back().GetName()), domain)))
+            break;
+        hzr.SetDNSName(result.GetNextDNSName());
+        hzr.SetHostedZoneId(result.GetNextHostedZoneId());
     }
-    else
+
+    if (found.empty())
     {
-        LOG(ERROR) << "ListHostedZones: "
-                   << outcome.GetError()
-                   << std::endl;
+        LOG(FATAL) << "No zone found\n";
+        exit(-1);
     }
-    return m_zone_id;
+
+    // Longest first, so the first suffix match is the most specific
+    std::stable_sort(found.begin(), found.end(), [](const auto &a, const auto &b) {
+        return a.name.size() > b.name.size();
+    });
+    m_zones = std::move(found);
+    m_discovered = true;
+    return true;
 }
 
-bool DnsHandler::list_records(records_t &dnsdata)
+std::string DnsHandler::get_hosted_zone()
 {
-    auto lrrs = Model::ListResourceRecordSetsRequest()
-                    .WithHostedZoneId(m_zone_id);
-    auto outcome = m_client->ListResourceRecordSets(lrrs);
-    if (outcome.IsSuccess())
+    if (!discover())
+        return "";
+    auto apex = zone_for(m_domain);
+    return apex ? apex->id : m_zones.back().id;
+}
+
+std::vector<DnsHandler::hosted_zone_t> DnsHandler::hosted_zones()
+{
+    if (!m_discovered)
+        return {};
+    return m_zones;
+}
+
+const DnsHandler::hosted_zone_t *DnsHandler::zone_for(const std::string &name) const
+{
+    if (!m_discovered)
+        return nullptr;
+    const auto fq = fqdn(name);
+    for (const auto &hz : m_zones)
+        if (in_zone(fq, hz.name))
+            return &hz;
+    return nullptr;
+}
+
+void DnsHandler::load_rrsets(zone_t &zone, const Aws::Vector<rrset_t> &rrsets)
+{
+    add_rrsets(zone, rrsets);
+    index_records(zone);
+}
+
+void DnsHandler::load_records(zone_t &zone, const records_t &records)
+{
+    for (const auto &row : records)
     {
-        auto result = outcome.GetResult().GetResourceRecordSets();
-        for (auto &r : result)
+        auto type = static_cast<Model::RRType>(std::get<TYPE>(row));
+        auto rrs = Model::ResourceRecordSet()
+                       .WithName(std::get<DOMAIN>(row) + ".")
+                       .WithType(type)
+                       .WithTTL(std::get<TTL>(row));
+        for (const auto &ip : std::get<IP_LIST>(row))
+            rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip.to_string()));
+        zone.rrsets[rrkey_t(rrs.GetName(), type)] = rrs;
+    }
+    index_records(zone);
+}
+
+void DnsHandler::add_rrsets(zone_t &zone, const Aws::Vector<rrset_t> &rrsets,
+                            const std::string &subtree)
+{
+    for (const auto &r : rrsets)
+        if ((r.GetType() == Model::RRType::A || r.GetType() == Model::RRType::AAAA)
+            && (subtree.empty() || in_zone(r.GetName(), subtree)))
+            zone.rrsets.insert_or_assign(zone.rrsets.end(), rrkey_t(r.GetName(), r.GetType()), r);
+}
+
+// Rows follow the RRset order, whichever zones they came from
+void DnsHandler::index_records(zone_t &zone)
+{
+    zone.records.clear();
+    zone.records.reserve(zone.rrsets.size());
+    for (const auto &entry : zone.rrsets)
+        zone.records.push_back(to_row(entry.second));
+}
+
+Model::RRType DnsHandler::type_of(const IpAddr &ip)
+{
+    return ip.is_v4() ? Model::RRType::A : Model::RRType::AAAA;
+}
+
+bool DnsHandler::list_pages(const hosted_zone_t &hz,
+                            const std::string &subtree,
+                            Model::RRType type,
+                            const page_t &page)
+{
+    auto request = Model::ListResourceRecordSetsRequest()
+                       .WithHostedZoneId(hz.id);
+    if (!subtree.empty())
+    {
+        request.SetStartRecordName(subtree);
+        if (type != Model::RRType::NOT_SET)
+            request.SetStartRecordType(type);
+    }
+
+    auto fetch = [this, &hz](Model::ListResourceRecordSetsRequest lrrs) {
+        static const route53_call_t list_rrsets("ListResourceRecordSets");
+        return list_rrsets(hz, [&] { return m_client->ListResourceRecordSets(lrrs); });
+    };
+
+    // The next page is requested as soon as its start is known, and
+    // is on the wire while the current one is handed over
+    auto outcome = fetch(request);
+    for (;;)
+    {
+        if (!outcome.IsSuccess())
         {
-            if (r.GetType() == m_dnstype)
-            {
-                iplist_t ips;
-                auto rr = r.GetResourceRecords();
-                for (const auto &ip : rr)
-                    ips.push_back(ip.GetValue());
-                // AWS API oddity. There's a period
-                // at the end of the returned domain
-                std::string domain = r.GetName();
-                domain.pop_back();
-                auto row = std::make_tuple(domain,
-                                           ips,
-                                           r.GetTTL(),
-                                           static_cast<char>(r.GetType()));
-                dnsdata.push_back(row);
-            }
+            LOG(ERROR) << "ListResourceRecordSets failed for " << hz.name << ": "
+                       << static_cast<int>(outcome.GetError().GetErrorType())
+                       << std::endl
+                       << outcome.GetError()
+                       << std::endl;
+            return false;
+        }
+
+        const auto &result = outcome.GetResult();
+        std::future<Model::ListResourceRecordSetsOutcome> next;
+        if (result.GetIsTruncated()
+            && (subtree.empty() || in_zone(result.GetNextRecordName(), subtree)))
+        {
+            request.SetStartRecordName(result.GetNextRecordName());
+            request.SetStartRecordType(result.GetNextRecordType());
+            if (!result.GetNextRecordIdentifier().empty())
+                request.SetStartRecordIdentifier(result.GetNextRecordIdentifier());
+            next = std::async(std::launch::async, fetch, request);
         }
+
+        page(result.GetResourceRecordSets());
+        if (!next.valid())
+            return true;
+        outcome = next.get();
+    }
+}
+
+bool DnsHandler::fetch_zone(const hosted_zone_t &hz, zone_t &zone,
+                            const std::string &subtree, Model::RRType type)
+{
+    return list_pages(hz, subtree, type, [&](const Aws::Vector<rrset_t> &rrsets) {
+        add_rrsets(zone, rrsets, subtree);
+    });
+}
+
+bool DnsHandler::fetch_zones(const std::vector<const hosted_zone_t *> &zones, zone_t &zone,
+                             const std::string &subtree, Model::RRType type)
+{
+    // Zones are listed concurrently, so a pass takes as long as the
+    // slowest zone. Each part is merged by moving its map nodes
+    if (zones.size() == 1)
+        return fetch_zone(*zones.front(), zone, subtree, type);
+
+    std::vector<zone_t> parts(zones.size());
+    std::vector<std::future<bool>> fetches;
+    fetches.reserve(zones.size());
+    for (size_t i = 0; i < zones.size(); i++)
+        fetches.push_back(std::async(std::launch::async, [&, i] {
+            return fetch_zone(*zones[i], parts[i], subtree, type);
+        }));
+
+    bool complete = true;
+    for (auto &fetch : fetches)
+        complete = fetch.get() && complete;
+    if (!complete)
+        return false;
+    for (auto &part : parts)
+        zone.rrsets.merge(part.rrsets);
+    return true;
+}
+
+DnsHandler::snapshot_t DnsHandler::snapshot()
+{
+    std::lock_guard<std::mutex> lock(m_snapshot_mtx);
+    return m_snapshot;
+}
+
+uint64_t DnsHandler::version()
+{
+    auto zone = snapshot();
+    return zone ? zone->version : 0;
+}
+
+bool DnsHandler::refresh()
+{
+    // Callers arriving while the zones are listed share that listing
+    return m_refreshes.run("zones", [this] { return reload(); });
+}
+
+bool DnsHandler::reload()
+{
+    // Writes published before this point are in the listing. Refreshes
+    // never overlap (see refresh()), so older ones are not needed
+    uint64_t writes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mtx);
+        writes = m_writes;
+        m_recent.clear();
+    }
+
+    // Until the zones are known, each refresh tries again
+    if (!discover())
+        return false;
+
+    std::vector<const hosted_zone_t *> zones;
+    for (const auto &hz : m_zones)
+        zones.push_back(&hz);
+    auto zone = std::make_shared<zone_t>();
+    if (!fetch_zones(zones, *zone))
+        return false;
+    index_records(*zone);
+    zone->fetched = std::chrono::system_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_snapshot_mtx);
+    if (writes != m_writes)
+    {
+        // Local writes landed while we were listing and our copy may
+        // predate them. Replaying them in order gives their end state
+        LOG(TRACE) << "Zone refresh raced " << m_recent.size() << " local writes (replayed)\n";
+        for (const auto &write : m_recent)
+            set_rrset(*zone, write.rrs, write.remove);
+        index_records(*zone);
     }
+    m_recent.clear();
+
+    // Leaving a stale snapshot is a change, even with the same records
+    if (m_snapshot && !m_snapshot->stale && m_snapshot->records == zone->records)
+        zone->version = m_snapshot->version;
     else
+        zone->version = (m_snapshot ? m_snapshot->version : 0) + 1;
+    m_snapshot = zone;
+    LOG(TRACE) << "Zone snapshot at version " << zone->version << "\n";
+    return true;
+}
+
+void DnsHandler::refresh_loop()
+{
+    // A seeded snapshot is revalidated at once. Without a fresh zone
+    // (seeded, or the first refresh failed) it is retried quickly
+    // until Route53 answers
+    auto next_wait = [this] {
+        auto zone = snapshot();
+        if (!zone || zone->stale)
+            return std::min<std::chrono::seconds>(5s, m_refresh_interval);
+        return m_refresh_interval;
+    };
+    auto seeded = snapshot();
+    auto wait = (seeded && seeded->stale) ? 0s : next_wait();
+
+    std::unique_lock<std::mutex> lock(m_refresh_mtx);
+    while (!m_refresh_cv.wait_for(lock, wait, [this] { return m_stop; }))
     {
-        LOG(ERROR) << "ListResourceRecordSets failed: "
-                   << static_cast<int>(outcome.GetError().GetErrorType())
-                   << std::endl
-                   << outcome.GetError()
-                   << std::endl;
+        lock.unlock();
+        if (!refresh())
+            LOG(WARNING) << "Zone refresh failed, serving the previous snapshot\n";
+        wait = next_wait();
+        lock.lock();
+    }
+}
+
+void DnsHandler::set_rrset(zone_t &zone, const rrset_t &rrs, bool remove)
+{
+    // Records returned by AWS always carry the trailing period
+    auto name = rrs.GetName();
+    if (name.empty() || name.back() != '.')
+        name += ".";
+
+    rrkey_t key(name, rrs.GetType());
+    if (remove)
+        zone.rrsets.erase(key);
+    else
+    {
+        zone.rrsets[key] = rrs;
+        zone.rrsets[key].SetName(name);
     }
+}
+
+void DnsHandler::publish(const rrset_t &rrs, bool remove)
+{
+    std::lock_guard<std::mutex> lock(m_snapshot_mtx);
+    m_writes++;
+    m_recent.push_back({rrs, remove});
+
+    // A zone holding only our own writes would pass for the whole
+    // zone. Without a listing yet, the first refresh brings them in
+    if (!m_snapshot)
+        return;
+    auto zone = std::make_shared<zone_t>(*m_snapshot);
+    set_rrset(*zone, rrs, remove);
+    index_records(*zone);
+
+    zone->version++;
+    m_snapshot = zone;
+}
+
+bool DnsHandler::list_records(records_t &dnsdata, bool live)
+{
+    if (live && !refresh())
+        return false;
+
+    auto zone = snapshot();
+    if (!zone)
+        return false;
+
+    dnsdata.insert(dnsdata.end(), zone->records.begin(), zone->records.end());
     return dnsdata.size() > 0;
 }
 
+bool DnsHandler::list_subtree(records_t &dnsdata,
+                              const std::string &name,
+                              Model::RRType type)
+{
+    // The zone holding the name, and any zone delegated below it
+    if (!discover())
+        return false;
+    const auto subtree = fqdn(name);
+    const auto owner = zone_for(subtree);
+    std::vector<const hosted_zone_t *> zones;
+    for (const auto &hz : m_zones)
+        if (&hz == owner || in_zone(hz.name, subtree))
+            zones.push_back(&hz);
+    if (zones.empty())
+    {
+        LOG(NOTICE) << "No hosted zone for [" << name << "]\n";
+        return false;
+    }
+
+    auto key = subtree + " " + std::to_string(static_cast<int>(type));
+    auto zone = m_subtrees.run(key, [&]() -> snapshot_t {
+        auto listed = std::make_shared<zone_t>();
+        if (!fetch_zones(zones, *listed, subtree, type))
+            return nullptr;
+        index_records(*listed);
+        return listed;
+    });
+    if (!zone)
+        return false;
+    dnsdata.insert(dnsdata.end(), zone->records.begin(), zone->records.end());
+    return true;
+}
+
 bool DnsHandler::get_record(const std::string &name,
-                            rrset_t &rr)
+                            rrset_t &rr,
+                            bool live,
+                            Model::RRType type)
 {
+    const char *type_name = (type == Model::RRType::AAAA) ? "AAAA" : "A";
+    if (!live)
+    {
+        auto zone = snapshot();
+        if (zone)
+        {
+            auto it = zone->rrsets.find({name + ".", type});
+            if (it != zone->rrsets.end())
+            {
+                rr = it->second;
+                return true;
+            }
+            LOG(NOTICE) << "Did not locate an " << type_name << " type DNS record for [" << name << "]\n";
+            return false;
+        }
+    }
+
+    auto hz = zone_for(name);
+    if (!hz)
+    {
+        LOG(NOTICE) << "No hosted zone for [" << name << "]\n";
+        return false;
+    }
+
     auto lrrs = Model::ListResourceRecordSetsRequest()
                     .WithStartRecordName(name)
-                    .WithStartRecordType(m_dnstype)
-                    .WithHostedZoneId(m_zone_id);
-    auto outcome = m_client->ListResourceRecordSets(lrrs);
+                    .WithStartRecordType(type)
+                    .WithHostedZoneId(hz->id);
+    static const route53_call_t list_rrsets("ListResourceRecordSets");
+    auto outcome = list_rrsets(*hz, [&] { return m_client->ListResourceRecordSets(lrrs); });
     if (outcome.IsSuccess())
     {
         auto result = outcome.GetResult().GetResourceRecordSets();
         for (auto &r : result)
-            if (r.GetName() == (name + "."))
+            if (r.GetName() == (name + ".") && r.GetType() == type)
             {
                 rr = r;
                 return true;
@@ -119,140 +640,375 @@ bool DnsHandler::get_record(const std::string &name,
                    << std::endl;
     }
 
-    LOG(NOTICE) << "Did not locate an A type DNS record for [" << name << "]\n";
+    LOG(NOTICE) << "Did not locate an " << type_name << " type DNS record for [" << name << "]\n";
     return false;
 }
 
-bool DnsHandler::update(const rrset_t &rrs, bool remove)
+bool DnsHandler::submit(const hosted_zone_t &hz,
+                        const Aws::Vector<Model::Change> &changes,
+                        std::string &change_id,
+                        uint64_t entry,
+                        const std::vector<size_t> &entry_ops)
 {
-    auto action = remove ? Model::ChangeAction::DELETE_ : Model::ChangeAction::UPSERT;
-    LOG(DEBUG) << "DNS Update (" << (remove ? "DELETE" : "UPSERT") << ")\n";
+    LOG(DEBUG) << "DNS Update of " << hz.name << " (" << changes.size() << " changes)\n";
 
-    auto chg = Model::Change()
-                   .WithAction(action)
-                   .WithResourceRecordSet(rrs);
+    auto batch = Model::ChangeBatch().WithComment("Automated");
+    for (const auto &chg : changes)
+        batch.AddChanges(chg);
     auto crrs = Model::ChangeResourceRecordSetsRequest()
-                    .WithHostedZoneId(m_zone_id)
-                    .WithChangeBatch(
-                        Model::ChangeBatch()
-                            .WithComment("Automated")
-                            .AddChanges(chg));
+                    .WithHostedZoneId(hz.id)
+                    .WithChangeBatch(batch);
 
-    auto outcome = m_client->ChangeResourceRecordSets(crrs);
+    static const route53_call_t change_records("ChangeResourceRecordSets");
+    auto outcome = change_records(hz, [&] { return m_client->ChangeResourceRecordSets(crrs); });
 
     if (outcome.IsSuccess())
     {
         LOG(TRACE) << "DNS update outcome successful\n";
-        unsigned sync_await = 120; // Wait for the sync
-        do
+
+        // Route53 lists the change as soon as it is accepted
+        for (const auto &chg : changes)
+            publish(chg.GetResourceRecordSet(),
+                    chg.GetAction() == Model::ChangeAction::DELETE_);
+
+        // Propagation is awaited by the tracker, not by the caller. The
+        // journal learns of the change before it can complete
+        auto id = outcome.GetResult().GetChangeInfo().GetId();
+        ChangeTracker::callback_t on_done = nullptr;
+        if (m_journal && entry)
         {
-            sleep(1);
-            auto id = outcome.GetResult().GetChangeInfo().GetId();
-            id = id.substr(id.rfind("/") + 1);
-            auto await_outcome = m_client->GetChange(
-                Model::GetChangeRequest().WithId(id));
-            if (await_outcome.IsSuccess())
-            {
-                auto ci = await_outcome.GetResult().GetChangeInfo();
-                if (ci.GetStatus() == Model::ChangeStatus::INSYNC)
-                    return true;
-                LOG(TRACE) << "Awaiting record syncronization ...\n";
-            }
-            else
-                LOG(ERROR) << "GetChange failed: "
-                           << static_cast<int>(outcome.GetError().GetErrorType())
-                           << std::endl
-                           << outcome.GetError()
-                           << std::endl;
-            sync_await--;
-        } while (sync_await);
-    }
-    else
-    {
-        LOG(ERROR) << "ChangeResourceRecordSets update failed: "
-                   << static_cast<int>(outcome.GetError().GetErrorType())
-                   << std::endl
-                   << outcome.GetError()
-                   << std::endl;
+            m_journal->submitted(entry, id.substr(id.rfind("/") + 1), entry_ops);
+            std::weak_ptr<Journal> journal = m_journal;
+            on_done = [journal](const std::string &handle, ChangeTracker::status_t) {
+                if (auto j = journal.lock())
+                    j->synced(handle);
+            };
+        }
+        change_id = m_tracker->track(id, on_done);
+        return true;
     }
 
+    LOG(ERROR) << "ChangeResourceRecordSets update failed: "
+               << static_cast<int>(outcome.GetError().GetErrorType())
+               << std::endl
+               << outcome.GetError()
+               << std::endl;
     return false;
 }
 
-bool DnsHandler::add_record(const std::string &name, const std::string &ip)
+bool DnsHandler::apply(mutations_t &ops)
 {
-    rrset_t rrs;
-    Aws::Vector<Model::ResourceRecord> rrv;
-    if (get_record(name, rrs))
+    const std::lock_guard<std::mutex> lock(m_apply_mtx);
+    discover();
+
+    // Group the operations per RRset (name and address family),
+    // keeping submission order
+    std::map<rrkey_t, std::vector<size_t>> by_rrset;
+    std::vector<IpAddr> addrs(ops.size());
+    for (size_t i = 0; i < ops.size(); i++)
     {
-        // Check if the value is already present
-        for (auto &rr : rrs.GetResourceRecords())
+        ops[i].ok = false;
+        ops[i].change_id.clear();
+        ops[i].error.clear();
+        if (!IpAddr::parse(ops[i].ip, addrs[i]))
         {
-            if (rr.GetValue() == ip)
-            {
-                LOG(NOTICE) << "Detected existing entry for ["
-                            << name << " / " << ip << " ]"
-                            << "\n";
-                return true;
-            }
+            LOG(NOTICE) << "Invalid address [" << ops[i].ip << "]\n";
+            ops[i].error = "invalid address";
+            continue;
         }
-        rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip));
+        if (!zone_for(ops[i].name))
+        {
+            LOG(NOTICE) << "No hosted zone for [" << ops[i].name << "]\n";
+            ops[i].error = "no hosted zone for name";
+            continue;
+        }
+        by_rrset[{ops[i].name, type_of(addrs[i])}].push_back(i);
     }
-    else
+
+    // Intent is on disk before anything is read or written
+    uint64_t seq = 0;
+    if (m_journal)
     {
-        LOG(DEBUG) << "Adding a new record for ["
-                   << name << " / " << ip << " ]"
-                   << "\n";
-
-        // Resource record set doesnt exist. Add one
-        rrs = Model::ResourceRecordSet()
-                  .WithName(name)
-                  .WithType(m_dnstype)
-                  .WithTTL(60);
-        rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip));
+        std::vector<Journal::op_t> intent;
+        for (const auto &op : ops)
+            intent.push_back({op.action == action_t::REMOVE, op.name, op.ip});
+        seq = m_journal->begin(intent);
+        if (!seq)
+            LOG(WARNING) << "Applying " << ops.size() << " changes without the journal\n";
     }
 
-    return update(rrs);
-}
+    auto current = snapshot();
+    bool stale = current && current->stale;
 
-bool DnsHandler::delete_record(const std::string &name, const std::string &ip)
-{
-    rrset_t rrs;
-    bool found = false;
-    Aws::Vector<Model::ResourceRecord> rrv;
-    if (get_record(name, rrs))
+    struct pending_t
+    {
+        Model::Change change;
+        size_t records;
+        size_t chars;
+        std::vector<size_t> ops;
+    };
+    std::map<const hosted_zone_t *, std::vector<pending_t>> by_zone;
+
+    for (const auto &entry : by_rrset)
     {
-        // Check if the value is present
-        for (auto &rec : rrs.GetResourceRecords())
+        const auto &name = entry.first.first;
+        auto type = entry.first.second;
+
+        // Read the RRset once and replay every operation on its values.
+        // A saved zone is never trusted for writes, Route53 is asked
+        rrset_t rrs;
+        bool exists = get_record(name, rrs, stale, type);
+        iplist_t initial = exists ? std::get<IP_LIST>(to_row(rrs)) : iplist_t();
+
+        iplist_t values = initial;
+        std::vector<size_t> touched;
+        for (auto i : entry.second)
         {
-            if (rec.GetValue() == ip)
+            auto &op = ops[i];
+            auto it = std::find(values.begin(), values.end(), addrs[i]);
+            if (op.action == action_t::ADD)
             {
-                found = true;
+                if (it != values.end())
+                {
+                    LOG(NOTICE) << "Detected existing entry for ["
+                                << name << " / " << op.ip << " ]"
+                                << "\n";
+                }
+                else
+                    values.push_back(addrs[i]);
+                op.ok = true;
             }
             else
-                // Push everything else into
-                // the update vector except the
-                // found IP
-                rrv.push_back(rec);
+            {
+                if (it == values.end())
+                {
+                    LOG(NOTICE) << "Did not find IP for [" << name << " / " << op.ip << " ]"
+                                << "\n";
+                    op.error = "address not published";
+                    continue;
+                }
+                values.erase(it);
+                op.ok = true;
+            }
+            touched.push_back(i);
         }
-    }
 
-    if (found)
-    {
-        if (rrv.empty())
+        // Edits that cancel out (e.g. add then remove) need no change
+        if (values == initial)
+            continue;
+
+        pending_t pending;
+        pending.ops = touched;
+        if (values.empty())
         {
-            LOG(TRACE) << "No other records on ResourceRecordSet\n";
-            rrv.push_back(Model::ResourceRecord().WithValue(ip));
-            return update(rrs, true);
+            // A DELETE has to match the published RRset exactly
+            pending.change = Model::Change()
+                                 .WithAction(Model::ChangeAction::DELETE_)
+                                 .WithResourceRecordSet(rrs);
+            pending.records = initial.size();
+            pending.chars = 0;
+            for (const auto &rr : rrs.GetResourceRecords())
+                pending.chars += rr.GetValue().length();
         }
         else
         {
-            LOG(TRACE) << "Other records exist on ResourceRecordSet\n";
+            if (!exists)
+            {
+                LOG(DEBUG) << "Adding a new record for [" << name << "]\n";
+
+                // Resource record set doesnt exist. Add one
+                rrs = Model::ResourceRecordSet()
+                          .WithName(name)
+                          .WithType(type)
+                          .WithTTL(60);
+            }
+
+            Aws::Vector<Model::ResourceRecord> rrv;
+            pending.chars = 0;
+            for (const auto &ip : values)
+            {
+                auto text = ip.to_string();
+                pending.chars += 2 * text.length();
+                rrv.push_back(Model::ResourceRecord().WithValue(text));
+            }
             rrs.SetResourceRecords(rrv);
-            return update(rrs);
+            pending.change = Model::Change()
+                                 .WithAction(Model::ChangeAction::UPSERT)
+                                 .WithResourceRecordSet(rrs);
+            pending.records = 2 * values.size();
         }
+        by_zone[zone_for(name)].push_back(pending);
     }
-    LOG(NOTICE) << "Did not find IP for [" << name << " / " << ip << " ]"
-                << "\n";
-    return false;
-}
\ No newline at end of file
+
+    // Pack each zone's RRset changes into as few batches as the limits allow
+    bool success = true;
+    for (const auto &zone : by_zone)
+    {
+        const auto &changes = zone.second;
+        size_t start = 0;
+        while (start < changes.size())
+        {
+            size_t end = start;
+            size_t records = 0;
+            size_t chars = 0;
+            Aws::Vector<Model::Change> batch;
+            while (end < changes.size()
+                   && (batch.empty()
+                       || (records + changes[end].records <= max_batch_records
+                           && chars + changes[end].chars <= max_batch_chars)))
+            {
+                records += changes[end].records;
+                chars += changes[end].chars;
+                batch.push_back(changes[end].change);
+                end++;
+            }
+
+            std::vector<size_t> batch_ops;
+            for (size_t i = start; i < end; i++)
+                batch_ops.insert(batch_ops.end(), changes[i].ops.begin(), changes[i].ops.end());
+
+            std::string change_id;
+            bool ok = submit(*zone.first, batch, change_id, seq, batch_ops);
+            success = success && ok;
+            for (size_t i = start; i < end; i++)
+                for (auto op : changes[i].ops)
+                {
+                    ops[op].ok = ok;
+                    ops[op].change_id = change_id;
+                    if (!ok)
+                        ops[op].error = "change rejected by Route53";
+                }
+            start = end;
+        }
+    }
+
+    if (m_journal)
+        m_journal->applied(seq);
+
+    return success && std::all_of(ops.begin(), ops.end(),
+                                  [](const auto &op) { return op.ok; });
+}
+
+size_t DnsHandler::resume(std::shared_ptr<Journal> journal)
+{
+    auto entries = journal->recover();
+    {
+        const std::lock_guard<std::mutex> lock(m_apply_mtx);
+        m_journal = journal;
+    }
+
+    // Only the unfinished entries are looked at, never the whole zone
+    for (const auto &entry : entries)
+    {
+        for (const auto &id : entry.changes)
+        {
+            LOG(INFO) << "Resuming change " << id << "\n";
+            m_tracker->track(id, [journal](const std::string &handle, ChangeTracker::status_t) {
+                journal->synced(handle);
+            });
+        }
+        if (entry.applied)
+            continue;
+
+        // Operations already submitted are not repeated. The others are
+        // applied again: adds and removes are idempotent on the RRset
+        mutations_t ops;
+        for (size_t i = 0; i < entry.ops.size(); i++)
+        {
+            if (entry.submitted[i])
+                continue;
+            const auto &op = entry.ops[i];
+            ops.push_back({op.name, op.ip, op.remove ? action_t::REMOVE : action_t::ADD});
+        }
+        if (!ops.empty())
+        {
+            LOG(INFO) << "Replaying " << ops.size() << " changes of journal entry "
+                      << entry.seq << "\n";
+            apply(ops);
+        }
+        journal->applied(entry.seq);
+    }
+    return entries.size();
+}
+
+std::future<DnsHandler::listing_t> DnsHandler::list_records_async(bool live)
+{
+    // Without a snapshot yet, the zones are listed
+    if (!live && snapshot())
+    {
+        listing_t listing;
+        listing.ok = list_records(listing.records);
+        return ready(std::move(listing));
+    }
+    return m_executor->submit([this] {
+        listing_t listing;
+        listing.ok = list_records(listing.records, true);
+        return listing;
+    });
+}
+
+std::future<DnsHandler::lookup_t> DnsHandler::get_record_async(const std::string &name,
+                                                               bool live,
+                                                               Model::RRType type)
+{
+    if (!live && snapshot())
+    {
+        lookup_t lookup;
+        lookup.ok = get_record(name, lookup.rrset, false, type);
+        return ready(std::move(lookup));
+    }
+    return m_executor->submit([this, name, type] {
+        lookup_t lookup;
+        lookup.ok = get_record(name, lookup.rrset, true, type);
+        return lookup;
+    });
+}
+
+std::future<DnsHandler::mutation_t> DnsHandler::add_record_async(const std::string &name,
+                                                                 const std::string &ip)
+{
+    return m_queue->submit({name, ip, action_t::ADD});
+}
+
+std::future<DnsHandler::mutation_t> DnsHandler::delete_record_async(const std::string &name,
+                                                                    const std::string &ip)
+{
+    return m_queue->submit({name, ip, action_t::REMOVE});
+}
+
+ChangeTracker::status_t DnsHandler::change_status(const std::string &change_id)
+{
+    return m_tracker->status(change_id);
+}
+
+ChangeTracker::status_t DnsHandler::await_change(const std::string &change_id,
+                                                 std::chrono::seconds timeout)
+{
+    return m_tracker->wait(change_id, timeout);
+}
+
+bool DnsHandler::add_record(const std::string &name, const std::string &ip)
+{
+    std::string change_id;
+    return add_record(name, ip, change_id);
+}
+
+bool DnsHandler::add_record(const std::string &name, const std::string &ip, std::string &change_id)
+{
+    auto op = add_record_async(name, ip).get();
+    change_id = op.change_id;
+    return op.ok;
+}
+
+bool DnsHandler::delete_record(const std::string &name, const std::string &ip)
+{
+    std::string change_id;
+    return delete_record(name, ip, change_id);
+}
+
+bool DnsHandler::delete_record(const std::string &name, const std::string &ip, std::string &change_id)
+{
+    auto op = delete_record_async(name, ip).get();
+    change_id = op.change_id;
+    return op.ok;
+}
@@ -0,0 +1,126 @@
+#include <dnskeeper.h>
+#include <DnsProvider.hpp>
+#include <Metrics.hpp>
+
+#include <aws/core/client/ClientConfiguration.h>
+#include <aws/core/client/DefaultRetryStrategy.h>
+
+Route53Provider::Route53Provider()
+{
+    // Retries are left to LimitedProvider, which shares one budget
+    Aws::Client::ClientConfiguration config;
+    config.retryStrategy = Aws::MakeShared<Aws::Client::DefaultRetryStrategy>("RouteClient", 0);
+    m_client = Aws::MakeShared<Route53Client>("RouteClient", config);
+}
+
+Model::ListHostedZonesByNameOutcome
+Route53Provider::ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request)
+{
+    return m_client->ListHostedZonesByName(request);
+}
+
+Model::ListResourceRecordSetsOutcome
+Route53Provider::ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request)
+{
+    return m_client->ListResourceRecordSets(request);
+}
+
+Model::ChangeResourceRecordSetsOutcome
+Route53Provider::ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request)
+{
+    return m_client->ChangeResourceRecordSets(request);
+}
+
+Model::GetChangeOutcome
+Route53Provider::GetChange(const Model::GetChangeRequest &request)
+{
+    return m_client->GetChange(request);
+}
+
+LimitedProvider::LimitedProvider(std::shared_ptr<DnsProvider> provider, RateLimiter &limiter)
+    : m_provider(provider),
+      m_limiter(limiter)
+{
+}
+
+bool LimitedProvider::retryable(const Aws::Client::AWSError<Route53Errors> &error, RateLimiter::kind_t kind)
+{
+    switch (error.GetErrorType())
+    {
+        // Rejected before anything was done
+        case Route53Errors::THROTTLING:
+        case Route53Errors::SLOW_DOWN:
+        case Route53Errors::PRIOR_REQUEST_NOT_COMPLETE:
+        case Route53Errors::SERVICE_UNAVAILABLE:
+            return true;
+
+        // The request may or may not have been applied
+        case Route53Errors::NETWORK_CONNECTION:
+        case Route53Errors::REQUEST_TIMEOUT:
+        case Route53Errors::INTERNAL_FAILURE:
+            return kind == RateLimiter::kind_t::READ;
+
+        default:
+            return kind == RateLimiter::kind_t::READ && error.ShouldRetry();
+    }
+}
+
+template <typename F>
+auto LimitedProvider::call(const char *name, RateLimiter::kind_t kind, F &&request)
+{
+    auto &retries = metrics::counter("dnskeeper_route53_retries_total",
+                                     "Route53 calls repeated after a retryable error",
+                                     {{"call", name}});
+    auto &latency = metrics::histogram("dnskeeper_route53_request_seconds",
+                                       "Route53 API call latency, per attempt",
+                                       {{"call", name}});
+
+    auto attempts = m_limiter.options().max_attempts;
+    auto delay = std::chrono::milliseconds(0);
+    for (unsigned attempt = 1;; attempt++)
+    {
+        // Waits for the budget and between attempts are not timed
+        m_limiter.acquire(kind);
+        auto outcome = [&] {
+            metrics::Timer timer(latency);
+            return request();
+        }();
+        if (outcome.IsSuccess() || attempt >= attempts || !retryable(outcome.GetError(), kind))
+            return outcome;
+
+        delay = m_limiter.backoff(delay);
+        retries.inc();
+        LOG(DEBUG) << name << " attempt " << attempt << " failed ("
+                   << outcome.GetError().GetExceptionName() << "), retrying in "
+                   << delay.count() << "ms\n";
+        std::this_thread::sleep_for(delay);
+    }
+}
+
+Model::ListHostedZonesByNameOutcome
+LimitedProvider::ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request)
+{
+    return call("ListHostedZonesByName", RateLimiter::kind_t::READ,
+                [&] { return m_provider->ListHostedZonesByName(request); });
+}
+
+Model::ListResourceRecordSetsOutcome
+LimitedProvider::ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request)
+{
+    return call("ListResourceRecordSets", RateLimiter::kind_t::READ,
+                [&] { return m_provider->ListResourceRecordSets(request); });
+}
+
+Model::ChangeResourceRecordSetsOutcome
+LimitedProvider::ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request)
+{
+    return call("ChangeResourceRecordSets", RateLimiter::kind_t::CHANGE,
+                [&] { return m_provider->ChangeResourceRecordSets(request); });
+}
+
+Model::GetChangeOutcome
+LimitedProvider::GetChange(const Model::GetChangeRequest &request)
+{
+    return call("GetChange", RateLimiter::kind_t::READ,
+                [&] { return m_provider->GetChange(request); });
+}
@@ -0,0 +1,57 @@
+#include <dnskeeper.h>
+#include <Executor.hpp>
+
+Executor::Executor(size_t workers)
+{
+    for (size_t i = 0; i < std::max<size_t>(1, workers); i++)
+        m_workers.emplace_back(&Executor::work_loop, this);
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void Executor::post(task_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cv.notify_one();
+}
+
+size_t Executor::queued()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_tasks.size();
+}
+
+void Executor::work_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true)
+    {
+        m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty())
+            return; // Stopped and drained
+
+        auto task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lock.unlock();
+        try {
+            task();
+        } catch(std::exception &x) {
+            LOG(ERROR) << "Executor task failed: " << x.what() << "\n";
+        } catch(...) {
+            LOG(ERROR) << "Executor task failed with an unknown exception\n";
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,250 @@
+#include <dnskeeper.h>
+#include <IpAddr.hpp>
+
+namespace {
+
+const uint8_t v4_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+// Longest text form: ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255
+const size_t max_text = 45;
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool parse_v4(std::string_view text, uint8_t *out)
+{
+    unsigned octets = 0, octet = 0, digits = 0;
+    for (char c : text)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            if (digits > 0 && octet == 0)
+                return false; // Leading zero
+            octet = octet * 10 + (c - '0');
+            if (++digits > 3 || octet > 255)
+                return false;
+        }
+        else if (c == '.' && digits > 0 && octets < 3)
+        {
+            out[octets++] = static_cast<uint8_t>(octet);
+            octet = digits = 0;
+        }
+        else
+            return false;
+    }
+    if (octets != 3 || digits == 0)
+        return false;
+    out[3] = static_cast<uint8_t>(octet);
+    return true;
+}
+
+bool parse_v6(std::string_view text, uint8_t *out)
+{
+    uint8_t bytes[16] = {};
+    size_t filled = 0;       // Bytes written
+    long gap = -1;           // Where "::" was seen
+    size_t i = 0;
+
+    if (text.size() < 2)
+        return false;
+    if (text[0] == ':')
+    {
+        if (text[1] != ':')
+            return false;
+        gap = 0;
+        i = 2;
+        if (i == text.size())
+        {
+            std::memset(out, 0, 16);
+            return true;
+        }
+    }
+
+    while (i < text.size())
+    {
+        if (filled == 16)
+            return false;
+
+        // A dotted quad may close the address
+        size_t end = text.find(':', i);
+        std::string_view group = text.substr(i, end == std::string_view::npos ? end : end - i);
+        if (end == std::string_view::npos && group.find('.') != std::string_view::npos)
+        {
+            if (filled > 12 || !parse_v4(group, bytes + filled))
+                return false;
+            filled += 4;
+            break;
+        }
+
+        if (group.empty() || group.size() > 4)
+            return false;
+        unsigned value = 0;
+        for (char c : group)
+        {
+            int h = hex_value(c);
+            if (h < 0)
+                return false;
+            value = (value << 4) | h;
+        }
+        bytes[filled++] = static_cast<uint8_t>(value >> 8);
+        bytes[filled++] = static_cast<uint8_t>(value);
+
+        if (end == std::string_view::npos)
+            break;
+        i = end + 1;
+        if (i < text.size() && text[i] == ':')
+        {
+            if (gap >= 0)
+                return false; // Only one "::"
+            gap = filled;
+            i++;
+            if (i == text.size())
+                break;
+        }
+        else if (i == text.size())
+            return false; // Trailing single ':'
+    }
+
+    if (gap >= 0)
+    {
+        if (filled == 16)
+            return false; // "::" has to stand for at least one group
+        size_t tail = filled - gap;
+        std::memmove(bytes + 16 - tail, bytes + gap, tail);
+        std::memset(bytes + gap, 0, 16 - tail - gap);
+    }
+    else if (filled != 16)
+        return false;
+
+    std::memcpy(out, bytes, 16);
+    return true;
+}
+
+} // anonymous namespace (private)
+
+IpAddr IpAddr::from_v4(uint32_t addr)
+{
+    IpAddr ip;
+    std::memcpy(ip.m_bytes.data(), v4_prefix, 12);
+    ip.m_bytes[12] = static_cast<uint8_t>(addr >> 24);
+    ip.m_bytes[13] = static_cast<uint8_t>(addr >> 16);
+    ip.m_bytes[14] = static_cast<uint8_t>(addr >> 8);
+    ip.m_bytes[15] = static_cast<uint8_t>(addr);
+    return ip;
+}
+
+IpAddr IpAddr::from_bytes(const uint8_t *bytes)
+{
+    IpAddr ip;
+    std::memcpy(ip.m_bytes.data(), bytes, ip.m_bytes.size());
+    return ip;
+}
+
+bool IpAddr::parse(std::string_view text, IpAddr &addr)
+{
+    if (text.empty() || text.size() > max_text)
+        return false;
+
+    IpAddr ip;
+    if (text.find(':') == std::string_view::npos)
+    {
+        std::memcpy(ip.m_bytes.data(), v4_prefix, 12);
+        if (!parse_v4(text, ip.m_bytes.data() + 12))
+            return false;
+    }
+    else if (!parse_v6(text, ip.m_bytes.data()))
+        return false;
+
+    addr = ip;
+    return true;
+}
+
+bool IpAddr::is_v4() const
+{
+    return std::memcmp(m_bytes.data(), v4_prefix, 12) == 0;
+}
+
+uint32_t IpAddr::v4() const
+{
+    return (static_cast<uint32_t>(m_bytes[12]) << 24) |
+           (static_cast<uint32_t>(m_bytes[13]) << 16) |
+           (static_cast<uint32_t>(m_bytes[14]) << 8) |
+           m_bytes[15];
+}
+
+std::string IpAddr::to_string() const
+{
+    std::string out;
+    out.reserve(is_v4() ? 15 : 39);
+    append_to(out);
+    return out;
+}
+
+void IpAddr::append_to(std::string &out) const
+{
+    if (is_v4())
+    {
+        for (int i = 12; i < 16; i++)
+        {
+            if (i > 12)
+                out += '.';
+            unsigned octet = m_bytes[i];
+            if (octet >= 100)
+                out += static_cast<char>('0' + octet / 100);
+            if (octet >= 10)
+                out += static_cast<char>('0' + octet / 10 % 10);
+            out += static_cast<char>('0' + octet % 10);
+        }
+        return;
+    }
+
+    unsigned groups[8];
+    for (int g = 0; g < 8; g++)
+        groups[g] = (m_bytes[2 * g] << 8) | m_bytes[2 * g + 1];
+
+    // The longest run of two or more zero groups is compressed,
+    // the first one on ties (RFC 5952 section 4.2)
+    int best = -1, best_len = 1;
+    for (int g = 0; g < 8;)
+    {
+        int len = 0;
+        while (g + len < 8 && groups[g + len] == 0)
+            len++;
+        if (len > best_len)
+        {
+            best = g;
+            best_len = len;
+        }
+        g += len ? len : 1;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    for (int g = 0; g < 8; g++)
+    {
+        if (g == best)
+        {
+            out += "::";
+            g += best_len - 1;
+            continue;
+        }
+        if (g > 0 && g != best + best_len)
+            out += ':';
+        bool leading = true;
+        for (int shift = 12; shift >= 0; shift -= 4)
+        {
+            unsigned nibble = (groups[g] >> shift) & 0xf;
+            if (leading && nibble == 0 && shift > 0)
+                continue;
+            leading = false;
+            out += digits[nibble];
+        }
+    }
+}
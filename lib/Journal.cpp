@@ -0,0 +1,341 @@
+#include <dnskeeper.h>
+#include <Journal.hpp>
+
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Fields never hold spaces, control characters or newlines
+std::string escape(const std::string &field)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(field.size());
+    for (unsigned char c : field)
+    {
+        if (c <= ' ' || c == '%' || c >= 0x7f)
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+        }
+        else
+            out += static_cast<char>(c);
+    }
+    return out.empty() ? "%" : out; // A lone % is the empty string
+}
+
+std::string unescape(const std::string &field)
+{
+    if (field == "%")
+        return "";
+    std::string out;
+    out.reserve(field.size());
+    for (size_t i = 0; i < field.size(); i++)
+    {
+        if (field[i] == '%' && i + 2 < field.size() && isxdigit(field[i + 1]) && isxdigit(field[i + 2]))
+        {
+            out += static_cast<char>(std::stoi(field.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else
+            out += field[i];
+    }
+    return out;
+}
+
+bool write_all(int fd, const std::string &data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        auto n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+std::string op_record(uint64_t seq, size_t index, size_t count, const Journal::op_t &op)
+{
+    return "O " + std::to_string(seq) + " " + std::to_string(index) + " " +
+           std::to_string(count) + " " + (op.remove ? "R " : "A ") +
+           escape(op.name) + " " + escape(op.ip) + "\n";
+}
+
+std::string change_record(uint64_t seq, const std::string &change_id, const std::vector<size_t> &ops)
+{
+    std::string indices;
+    for (auto i : ops)
+        indices += (indices.empty() ? "" : ",") + std::to_string(i);
+    return "C " + std::to_string(seq) + " " + escape(change_id) + " " + escape(indices) + "\n";
+}
+
+} // anonymous namespace (private)
+
+Journal::Journal(const std::string &path, size_t max_size)
+    : m_path(path),
+      m_max_size(max_size)
+{
+    m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        LOG(ERROR) << "Journal " << m_path << " unavailable: " << strerror(errno) << "\n";
+        m_failed = true;
+    }
+    m_flusher = std::thread(&Journal::flush_loop, this);
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_flusher.joinable())
+        m_flusher.join();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool Journal::ok()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return !m_failed;
+}
+
+size_t Journal::live()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_live.size();
+}
+
+std::vector<Journal::entry_t> Journal::recover()
+{
+    std::map<uint64_t, entry_t> entries;
+    std::map<uint64_t, std::set<size_t>> seen; // Operations read per entry
+    std::set<std::string> synced;
+    uint64_t max_seq = 0;
+
+    // A torn last line (no newline) was never acknowledged
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (in.eof())
+            break;
+        std::istringstream fields(line);
+        std::string kind;
+        uint64_t seq = 0;
+        fields >> kind;
+        if (kind == "O")
+        {
+            size_t index, count;
+            std::string action, name, ip;
+            if (!(fields >> seq >> index >> count >> action >> name >> ip) || index >= count)
+                continue;
+            auto &entry = entries[seq];
+            entry.seq = seq;
+            if (entry.ops.size() != count)
+            {
+                entry.ops.resize(count);
+                entry.submitted.resize(count, false);
+                seen[seq].clear();
+            }
+            seen[seq].insert(index);
+            entry.ops[index] = {action == "R", unescape(name), unescape(ip)};
+            max_seq = std::max(max_seq, seq);
+        }
+        else if (kind == "C")
+        {
+            std::string change_id, indices;
+            if (!(fields >> seq >> change_id >> indices) || !entries.count(seq))
+                continue;
+            auto &entry = entries[seq];
+            entry.changes.push_back(unescape(change_id));
+            std::stringstream list(unescape(indices));
+            for (std::string index; std::getline(list, index, ',');)
+            {
+                long i = -1;
+                if (cast(index, i) && i >= 0 && static_cast<size_t>(i) < entry.submitted.size())
+                    entry.submitted[i] = true;
+            }
+        }
+        else if (kind == "D")
+        {
+            if (fields >> seq && entries.count(seq))
+                entries[seq].applied = true;
+        }
+        else if (kind == "S")
+        {
+            std::string change_id;
+            if (fields >> change_id)
+                synced.insert(unescape(change_id));
+        }
+    }
+
+    // Keep what still needs work, in order
+    std::vector<entry_t> pending;
+    std::string compacted;
+    for (auto &item : entries)
+    {
+        auto &entry = item.second;
+        if (seen[entry.seq].size() != entry.ops.size())
+            continue;
+        entry.changes.erase(std::remove_if(entry.changes.begin(), entry.changes.end(),
+                                           [&](const auto &id) { return synced.count(id) > 0; }),
+                            entry.changes.end());
+        if (entry.applied && entry.changes.empty())
+            continue;
+
+        for (size_t i = 0; i < entry.ops.size(); i++)
+            compacted += op_record(entry.seq, i, entry.ops.size(), entry.ops[i]);
+        std::vector<size_t> done;
+        for (size_t i = 0; i < entry.submitted.size(); i++)
+            if (entry.submitted[i])
+                done.push_back(i);
+        for (const auto &id : entry.changes)
+            compacted += change_record(entry.seq, id, done);
+        if (entry.applied)
+            compacted += "D " + std::to_string(entry.seq) + "\n";
+        pending.push_back(entry);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_seq = std::max(m_seq, max_seq);
+    for (const auto &entry : pending)
+    {
+        auto &live = m_live[entry.seq];
+        live.applied = entry.applied;
+        for (const auto &id : entry.changes)
+        {
+            live.changes.insert(id);
+            m_change_seq[id] = entry.seq;
+        }
+    }
+
+    // Swap in the compacted file atomically
+    auto tmp = m_path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0 && write_all(fd, compacted) && fsync(fd) == 0
+        && rename(tmp.c_str(), m_path.c_str()) == 0)
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = open(m_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        m_failed = (m_fd < 0);
+        m_size = compacted.size();
+    }
+    else
+        LOG(WARNING) << "Journal " << m_path << " not compacted: " << strerror(errno) << "\n";
+    if (fd >= 0)
+        close(fd);
+
+    LOG(INFO) << "Journal " << m_path << ": " << pending.size() << " unfinished entries\n";
+    return pending;
+}
+
+uint64_t Journal::append(const std::string &records)
+{
+    m_buffer += records;
+    m_cv.notify_one();
+    return ++m_written;
+}
+
+void Journal::finish_if_done(uint64_t seq)
+{
+    auto it = m_live.find(seq);
+    if (it != m_live.end() && it->second.applied && it->second.changes.empty())
+        m_live.erase(it);
+}
+
+uint64_t Journal::begin(const std::vector<op_t> &ops)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (m_failed)
+        return 0;
+
+    auto seq = ++m_seq;
+    std::string records;
+    for (size_t i = 0; i < ops.size(); i++)
+        records += op_record(seq, i, ops.size(), ops[i]);
+    m_live[seq];
+    auto ticket = append(records);
+    m_sync_cv.wait(lock, [&] { return m_synced >= ticket || m_failed; });
+    return m_failed ? 0 : seq;
+}
+
+void Journal::submitted(uint64_t seq, const std::string &change_id, const std::vector<size_t> &ops)
+{
+    if (seq == 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_live[seq].changes.insert(change_id);
+    m_change_seq[change_id] = seq;
+    append(change_record(seq, change_id, ops));
+}
+
+void Journal::applied(uint64_t seq)
+{
+    if (seq == 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_live[seq].applied = true;
+    append("D " + std::to_string(seq) + "\n");
+    finish_if_done(seq);
+}
+
+void Journal::synced(const std::string &change_id)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_change_seq.find(change_id);
+    if (it == m_change_seq.end())
+        return;
+    auto seq = it->second;
+    m_change_seq.erase(it);
+    m_live[seq].changes.erase(change_id);
+    append("S " + escape(change_id) + "\n");
+    finish_if_done(seq);
+}
+
+void Journal::flush_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true)
+    {
+        m_cv.wait(lock, [this] { return m_stop || !m_buffer.empty(); });
+        if (m_buffer.empty())
+            return; // Stopped and drained
+
+        // Everything queued so far goes out with one sync
+        std::string batch;
+        batch.swap(m_buffer);
+        auto ticket = m_written;
+        int fd = m_fd;
+        lock.unlock();
+
+        bool ok = fd >= 0 && write_all(fd, batch) && fdatasync(fd) == 0;
+        if (!ok)
+            LOG(ERROR) << "Journal " << m_path << " write failed: " << strerror(errno) << "\n";
+
+        lock.lock();
+        m_failed = m_failed || !ok;
+        m_synced = ticket;
+        m_size += batch.size();
+        m_sync_cv.notify_all();
+
+        // Nothing in the file is needed any more
+        if (ok && m_buffer.empty() && m_live.empty() && m_size > m_max_size)
+        {
+            if (ftruncate(m_fd, 0) == 0)
+                m_size = 0;
+        }
+    }
+}
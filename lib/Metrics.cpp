@@ -0,0 +1,209 @@
+#include <dnskeeper.h>
+#include <Metrics.hpp>
+
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace metrics {
+
+constexpr double Histogram::bounds[];
+
+namespace {
+
+enum class type_t
+{
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+struct family_t
+{
+    std::string help;
+    type_t type;
+    // Metrics never move once registered, references stay valid
+    std::map<std::string /*labels*/, std::unique_ptr<Counter>> counters;
+    std::map<std::string /*labels*/, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string /*labels*/, std::unique_ptr<Histogram>> histograms;
+};
+
+struct registry_t
+{
+    std::mutex mtx;
+    std::map<std::string, family_t> families;
+};
+
+registry_t &registry()
+{
+    static registry_t reg;
+    return reg;
+}
+
+std::string format_labels(const labels_t &labels)
+{
+    std::string out;
+    for (const auto &label : labels)
+    {
+        if (!out.empty())
+            out += ',';
+        out += label.first + "=\"";
+        for (char c : label.second)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += (c == '\n') ? ' ' : c;
+        }
+        out += '"';
+    }
+    return out;
+}
+
+family_t &family(const std::string &name, const std::string &help, type_t type)
+{
+    auto &fam = registry().families[name];
+    if (fam.help.empty())
+    {
+        fam.help = help;
+        fam.type = type;
+    }
+    return fam;
+}
+
+// Joins the metric labels with an extra one (e.g. le for buckets)
+std::string with_label(const std::string &labels, const std::string &extra)
+{
+    if (labels.empty())
+        return "{" + extra + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+std::string braced(const std::string &labels)
+{
+    return labels.empty() ? "" : "{" + labels + "}";
+}
+
+} // anonymous namespace (private)
+
+size_t shard()
+{
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return index;
+}
+
+uint64_t Counter::value() const
+{
+    uint64_t total = 0;
+    for (const auto &cell : m_cells)
+        total += cell.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Histogram::observe(std::chrono::nanoseconds elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    size_t bucket = 0;
+    while (bucket < bucket_count - 1 && seconds > bounds[bucket])
+        bucket++;
+
+    auto &cell = m_cells[shard()];
+    cell.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    cell.sum_ns.fetch_add(elapsed.count(), std::memory_order_relaxed);
+}
+
+Histogram::snapshot_t Histogram::snapshot() const
+{
+    snapshot_t snap;
+    uint64_t sum_ns = 0;
+    for (const auto &cell : m_cells)
+    {
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            auto n = cell.buckets[i].load(std::memory_order_relaxed);
+            snap.buckets[i] += n;
+            snap.count += n;
+        }
+        sum_ns += cell.sum_ns.load(std::memory_order_relaxed);
+    }
+    snap.sum = sum_ns / 1e9;
+    return snap;
+}
+
+Counter &counter(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    std::lock_guard<std::mutex> lock(registry().mtx);
+    auto &metric = family(name, help, type_t::COUNTER).counters[format_labels(labels)];
+    if (!metric)
+        metric = std::make_unique<Counter>();
+    return *metric;
+}
+
+Gauge &gauge(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    std::lock_guard<std::mutex> lock(registry().mtx);
+    auto &metric = family(name, help, type_t::GAUGE).gauges[format_labels(labels)];
+    if (!metric)
+        metric = std::make_unique<Gauge>();
+    return *metric;
+}
+
+Histogram &histogram(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    std::lock_guard<std::mutex> lock(registry().mtx);
+    auto &metric = family(name, help, type_t::HISTOGRAM).histograms[format_labels(labels)];
+    if (!metric)
+        metric = std::make_unique<Histogram>();
+    return *metric;
+}
+
+std::string render()
+{
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(registry().mtx);
+    for (const auto &entry : registry().families)
+    {
+        const auto &name = entry.first;
+        const auto &fam = entry.second;
+        out << "# HELP " << name << " " << fam.help << "\n";
+        switch (fam.type)
+        {
+            case type_t::COUNTER:
+                out << "# TYPE " << name << " counter\n";
+                for (const auto &metric : fam.counters)
+                    out << name << braced(metric.first) << " " << metric.second->value() << "\n";
+                break;
+
+            case type_t::GAUGE:
+                out << "# TYPE " << name << " gauge\n";
+                for (const auto &metric : fam.gauges)
+                    out << name << braced(metric.first) << " " << metric.second->value() << "\n";
+                break;
+
+            case type_t::HISTOGRAM:
+                out << "# TYPE " << name << " histogram\n";
+                for (const auto &metric : fam.histograms)
+                {
+                    auto snap = metric.second->snapshot();
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i < Histogram::bucket_count; i++)
+                    {
+                        cumulative += snap.buckets[i];
+                        std::ostringstream le;
+                        if (i < Histogram::bucket_count - 1)
+                            le << "le=\"" << Histogram::bounds[i] << "\"";
+                        else
+                            le << "le=\"+Inf\"";
+                        out << name << "_bucket" << with_label(metric.first, le.str())
+                            << " " << cumulative << "\n";
+                    }
+                    out << name << "_sum" << braced(metric.first) << " " << snap.sum << "\n";
+                    out << name << "_count" << braced(metric.first) << " " << snap.count << "\n";
+                }
+                break;
+        }
+    }
+    return out.str();
+}
+
+} // namespace metrics
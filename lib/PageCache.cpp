@@ -0,0 +1,100 @@
+#include <dnskeeper.h>
+#include <PageCache.hpp>
+#include <Metrics.hpp>
+
+#include <iomanip>
+#include <sstream>
+#include <zlib.h>
+
+bool PageCache::gzip(const std::string &data, std::string &compressed)
+{
+    z_stream zs = {};
+    // 15 window bits plus 16 selects the gzip wrapper
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    compressed.resize(deflateBound(&zs, data.size()));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+    zs.avail_out = compressed.size();
+
+    auto ret = deflate(&zs, Z_FINISH);
+    compressed.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        compressed.clear();
+        return false;
+    }
+    return true;
+}
+
+std::string PageCache::etag(const std::string &data)
+{
+    // FNV-1a (64 bit)
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream oss;
+    oss << '"' << std::hex << std::setw(16) << std::setfill('0') << hash << '"';
+    return oss.str();
+}
+
+PageCache::page_ptr PageCache::find(const std::string &key, const version_t &version)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_pages.find(key);
+    if (it == m_pages.end() || it->second->version != version)
+        return nullptr;
+    return it->second;
+}
+
+PageCache::page_ptr PageCache::store(const std::string &key,
+                                     const version_t &version,
+                                     std::string body,
+                                     const std::string &mime)
+{
+    auto page = std::make_shared<page_t>();
+    page->version = version;
+    page->etag = etag(body);
+    if (!gzip(body, page->gzip))
+        LOG(WARNING) << "Page " << key << " could not be compressed\n";
+    page->body = std::move(body);
+    page->mime = mime;
+
+    // Versions of 0 mean the data is not tracked yet (nothing loaded)
+    if (version.first && version.second)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_pages[key] = page;
+    }
+    return page;
+}
+
+PageCache::page_ptr PageCache::get(const std::string &key,
+                                   const version_t &version,
+                                   const builder_t &build,
+                                   const std::string &mime)
+{
+    static auto &shared = metrics::counter("dnskeeper_page_builds_shared_total",
+                                           "Page requests served by a build already in progress");
+    auto page = find(key, version);
+    if (page)
+        return page;
+
+    bool joined = false;
+    auto flight = key + "@" + std::to_string(version.first) + "." + std::to_string(version.second);
+    page = m_builds.run(flight, [&] {
+        // The build that just finished may have stored it
+        auto built = find(key, version);
+        return built ? built : store(key, version, build(), mime);
+    }, &joined);
+    if (joined)
+        shared.inc();
+    return page;
+}
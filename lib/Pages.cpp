@@ -0,0 +1,51 @@
+#include <dnskeeper.h>
+#include <Pages.hpp>
+#include <Reconciler.hpp>
+
+void build_dns_page(DnsUI &ui,
+                    const DnsHandler::records_t &records,
+                    const SrvCache::records_t &servers,
+                    const std::string &domain_name)
+{
+    Reconciler diff(records, servers, domain_name);
+    ui.reserve(diff.addresses().size());
+    for (const auto &address : diff.addresses())
+    {
+        // DNS records
+        // name|IP list|TTL|type
+        const auto &row = records[address.record];
+        const auto &domain = std::get<DnsHandler::DOMAIN>(row);
+        auto ip = std::get<DnsHandler::IP_LIST>(row)[address.ip].to_string();
+
+        if (address.server == Reconciler::npos)
+        {
+            ui.add_row({domain, ip, "not found", "N/A"}, true);
+            continue;
+        }
+
+        // Server records
+        // id|ip|server_name|cluster_id|cluster_name|subdomain
+        for (auto s = address.server; s != Reconciler::npos; s = diff.next(s))
+            ui.add_row({domain, ip, servers[s][SrvCache::NAME], servers[s][SrvCache::CLUSTER_NAME]});
+    }
+}
+
+void build_servers_page(ServerUI &ui,
+                        const DnsHandler::records_t &records,
+                        const SrvCache::records_t &servers,
+                        const std::string &domain_name)
+{
+    Reconciler diff(records, servers, domain_name);
+    ui.reserve(servers.size());
+    for (size_t s = 0; s < servers.size(); s++)
+    {
+        // Server records
+        // id|ip|server_name|cluster_id|cluster_name|subdomain
+        const auto &row = servers[s];
+        auto domain = row[SrvCache::SUBDOMAIN] + "." + domain_name;
+        if (diff.published(s))
+            ui.removal(row[SrvCache::NAME], domain, row[SrvCache::IP_ADDR]);
+        else
+            ui.addition(row[SrvCache::NAME], domain, row[SrvCache::IP_ADDR]);
+    }
+}
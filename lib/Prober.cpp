@@ -0,0 +1,428 @@
+#include <dnskeeper.h>
+#include <Prober.hpp>
+#include <Metrics.hpp>
+
+#include <algorithm>
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+metrics::Counter &probe_failures()
+{
+    static auto &failures = metrics::counter("dnskeeper_probe_failures_total",
+                                             "Failed health probes");
+    return failures;
+}
+
+metrics::Gauge &probe_targets(const char *state)
+{
+    return metrics::gauge("dnskeeper_probe_targets",
+                          "Probed addresses by state",
+                          {{"state", state}});
+}
+
+// Non-blocking connect to ip:port. Returns the socket, -1 on an
+// immediate failure. connected is set if no wait was needed
+int connect_to(const IpAddr &ip, uint16_t port, bool &connected)
+{
+    sockaddr_storage addr = {};
+    socklen_t len;
+    if (ip.is_v4())
+    {
+        auto sin = reinterpret_cast<sockaddr_in *>(&addr);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        sin->sin_addr.s_addr = htonl(ip.v4());
+        len = sizeof(sockaddr_in);
+    }
+    else
+    {
+        auto sin6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        std::memcpy(sin6->sin6_addr.s6_addr, ip.bytes().data(), 16);
+        len = sizeof(sockaddr_in6);
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), len) == 0)
+        connected = true;
+    else if (errno == EINPROGRESS)
+        connected = false;
+    else
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // anonymous namespace
+
+Prober::Prober(const options_t &options, source_t source, rotator_t rotator)
+    : m_options(options),
+      m_source(source),
+      m_rotator(rotator)
+{
+    m_request = "GET " + m_options.path + " HTTP/1.0\r\n"
+                "User-Agent: dnskeeper\r\n"
+                "Connection: close\r\n\r\n";
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+    {
+        LOG(ERROR) << "Health prober disabled, epoll unavailable: " << strerror(errno) << "\n";
+        return;
+    }
+    m_thread = std::thread(&Prober::probe_loop, this);
+}
+
+Prober::~Prober()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stop_mtx);
+        m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+    for (const auto &probe : m_probes)
+        close(probe.first);
+    if (m_epoll >= 0)
+        close(m_epoll);
+}
+
+const char *Prober::to_string(state_t state)
+{
+    switch (state)
+    {
+        case state_t::UP:
+            return "UP";
+        case state_t::DOWN:
+            return "DOWN";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+std::vector<Prober::status_t> Prober::status()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_targets;
+}
+
+void Prober::load_targets()
+{
+    targets_t targets;
+    if (!m_source(targets))
+    {
+        LOG(WARNING) << "Health prober could not load its targets, keeping the previous ones\n";
+        return;
+    }
+
+    // Targets keep their state across reloads. A pulled address that
+    // left the inventory is forgotten, not restored
+    std::lock_guard<std::mutex> lock(m_mtx);
+    std::unordered_map<std::string, size_t> previous;
+    for (size_t i = 0; i < m_targets.size(); i++)
+    {
+        auto key = m_targets[i].name + "|";
+        m_targets[i].ip.append_to(key);
+        previous[key] = i;
+    }
+
+    std::vector<status_t> updated;
+    updated.reserve(targets.size());
+    for (const auto &target : targets)
+    {
+        auto key = target.name + "|";
+        target.ip.append_to(key);
+        auto it = previous.find(key);
+        if (it == previous.end())
+        {
+            status_t st;
+            st.name = target.name;
+            st.ip = target.ip;
+            updated.push_back(st);
+        }
+        else if (it->second != SIZE_MAX)
+        {
+            updated.push_back(m_targets[it->second]);
+            it->second = SIZE_MAX; // Duplicates are probed once
+        }
+    }
+    m_targets.swap(updated);
+}
+
+void Prober::start(size_t target)
+{
+    IpAddr ip;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        ip = m_targets[target].ip;
+    }
+
+    bool connected = false;
+    int fd = connect_to(ip, m_options.port, connected);
+    if (fd < 0)
+    {
+        record(target, false);
+        return;
+    }
+
+    probe_t probe;
+    probe.target = target;
+    probe.seq = ++m_seq;
+    m_probes[fd] = probe;
+    m_deadlines.emplace_back(clock_t::now() + m_options.timeout, fd, probe.seq);
+
+    epoll_event ev = {};
+    ev.events = EPOLLOUT;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+        finish(fd, false);
+    else if (connected)
+        handle(fd, EPOLLOUT);
+}
+
+void Prober::handle(int fd, uint32_t events)
+{
+    auto it = m_probes.find(fd);
+    if (it == m_probes.end())
+        return;
+    auto &probe = it->second;
+
+    if (!probe.connected)
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if ((events & (EPOLLERR | EPOLLHUP))
+            || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0
+            || error != 0)
+        {
+            finish(fd, false);
+            return;
+        }
+        if (m_options.check == check_t::TCP)
+        {
+            finish(fd, true);
+            return;
+        }
+
+        // The request fits in the socket buffer of a new connection
+        if (send(fd, m_request.data(), m_request.size(), MSG_NOSIGNAL)
+            != static_cast<ssize_t>(m_request.size()))
+        {
+            finish(fd, false);
+            return;
+        }
+        probe.connected = true;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev);
+        return;
+    }
+
+    // Only the status line matters: HTTP/1.x NNN
+    char buffer[256];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0 && probe.reply.size() < 1024)
+        probe.reply.append(buffer, n);
+    if (n < 0 && errno == EAGAIN && probe.reply.find('\n') == std::string::npos)
+        return; // More to come
+
+    bool healthy = false;
+    if (probe.reply.compare(0, 5, "HTTP/") == 0)
+    {
+        auto space = probe.reply.find(' ');
+        if (space != std::string::npos && space + 4 <= probe.reply.size())
+        {
+            int code = 0;
+            healthy = cast(probe.reply.substr(space + 1, 3), code) && code >= 200 && code < 400;
+        }
+    }
+    finish(fd, healthy);
+}
+
+void Prober::finish(int fd, bool healthy)
+{
+    auto it = m_probes.find(fd);
+    if (it == m_probes.end())
+        return;
+    auto target = it->second.target;
+    m_probes.erase(it);
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    record(target, healthy);
+}
+
+void Prober::record(size_t target, bool healthy)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto &st = m_targets[target];
+    if (healthy)
+    {
+        st.failures = 0;
+        st.successes++;
+        if (st.state != state_t::UP && st.successes >= m_options.rise)
+        {
+            LOG(INFO) << "Health probe: " << st.name << " " << st.ip.to_string() << " is UP\n";
+            st.state = state_t::UP;
+            st.refused = false;
+        }
+    }
+    else
+    {
+        probe_failures().inc();
+        st.successes = 0;
+        st.failures++;
+        if (st.state != state_t::DOWN && st.failures >= m_options.fall)
+        {
+            LOG(WARNING) << "Health probe: " << st.name << " " << st.ip.to_string() << " is DOWN\n";
+            st.state = state_t::DOWN;
+        }
+    }
+}
+
+void Prober::rotate()
+{
+    rotations_t changes;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+
+        // Restores first, they free room under the cap
+        size_t pulled = 0;
+        for (const auto &st : m_targets)
+        {
+            if (st.pulled && st.state == state_t::UP)
+                changes.push_back({st.name, st.ip, false});
+            else if (st.pulled)
+                pulled++;
+        }
+
+        size_t held = 0;
+        for (const auto &st : m_targets)
+        {
+            // A refused pull would take the slot of the next DOWN address
+            // every round
+            if (st.pulled || st.refused || st.state != state_t::DOWN)
+                continue;
+            if (pulled < m_options.max_pulled)
+            {
+                changes.push_back({st.name, st.ip, true});
+                pulled++;
+            }
+            else
+                held++;
+        }
+        if (held > 0)
+            LOG(WARNING) << "Health probe: " << held << " DOWN address(es) kept in DNS, "
+                         << m_options.max_pulled << " already pulled\n";
+    }
+    if (changes.empty())
+        return;
+
+    m_rotator(changes);
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (const auto &chg : changes)
+    {
+        if (!chg.ok)
+        {
+            LOG(WARNING) << "Health probe: could not " << (chg.pull ? "pull " : "restore ")
+                         << chg.name << " " << chg.ip.to_string() << "\n";
+            if (chg.pull)
+                for (auto &st : m_targets)
+                    if (st.name == chg.name && st.ip == chg.ip)
+                        st.refused = true;
+            continue;
+        }
+        LOG(NOTICE) << "Health probe: " << (chg.pull ? "pulled " : "restored ")
+                    << chg.name << " " << chg.ip.to_string() << "\n";
+        for (auto &st : m_targets)
+            if (st.name == chg.name && st.ip == chg.ip)
+                st.pulled = chg.pull;
+    }
+}
+
+void Prober::probe_loop()
+{
+    static auto &up = probe_targets("up");
+    static auto &down = probe_targets("down");
+    static auto &unknown = probe_targets("unknown");
+    static auto &pulled = probe_targets("pulled");
+    static auto &round_time = metrics::histogram("dnskeeper_probe_round_seconds",
+                                                 "Time to probe every address once");
+
+    std::vector<epoll_event> events(64);
+    while (!m_stop)
+    {
+        auto round_start = clock_t::now();
+        load_targets();
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            count = m_targets.size();
+        }
+
+        size_t next = 0;
+        while ((next < count || !m_probes.empty()) && !m_stop)
+        {
+            while (next < count && m_probes.size() < m_options.max_in_flight)
+                start(next++);
+
+            // Deadlines expire in start order
+            auto now = clock_t::now();
+            while (!m_deadlines.empty() && std::get<0>(m_deadlines.front()) <= now)
+            {
+                auto fd = std::get<1>(m_deadlines.front());
+                auto it = m_probes.find(fd);
+                if (it != m_probes.end() && it->second.seq == std::get<2>(m_deadlines.front()))
+                    finish(fd, false);
+                m_deadlines.pop_front();
+            }
+            if (m_probes.empty())
+                continue;
+
+            // Short waits keep shutdown responsive
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::get<0>(m_deadlines.front()) - now);
+            int timeout = static_cast<int>(std::clamp<long>(wait.count() + 1, 1, 100));
+            int n = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), timeout);
+            for (int i = 0; i < n; i++)
+                handle(events[i].data.fd, events[i].events);
+        }
+        if (m_stop)
+            break;
+        m_deadlines.clear();
+
+        rotate();
+        round_time.observe(clock_t::now() - round_start);
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            int64_t n_up = 0, n_down = 0, n_pulled = 0;
+            for (const auto &st : m_targets)
+            {
+                n_up += (st.state == state_t::UP);
+                n_down += (st.state == state_t::DOWN);
+                n_pulled += st.pulled;
+            }
+            up.set(n_up);
+            down.set(n_down);
+            unknown.set(static_cast<int64_t>(m_targets.size()) - n_up - n_down);
+            pulled.set(n_pulled);
+        }
+        m_rounds++;
+
+        std::unique_lock<std::mutex> lock(m_stop_mtx);
+        m_stop_cv.wait_until(lock, round_start + m_options.interval, [this] { return m_stop.load(); });
+    }
+}
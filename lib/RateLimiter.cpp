@@ -0,0 +1,68 @@
+#include <dnskeeper.h>
+#include <RateLimiter.hpp>
+#include <Metrics.hpp>
+
+#include <algorithm>
+
+RateLimiter::RateLimiter()
+    : RateLimiter(options_t())
+{
+}
+
+RateLimiter::RateLimiter(const options_t &options)
+    : m_rng(std::random_device{}())
+{
+    configure(options);
+}
+
+RateLimiter &RateLimiter::process()
+{
+    static RateLimiter limiter;
+    return limiter;
+}
+
+void RateLimiter::configure(const options_t &options)
+{
+    // A bucket holds one second of requests, at least one
+    auto read = std::make_shared<TokenBucket>(options.read_rate, options.read_rate);
+    auto change = std::make_shared<TokenBucket>(options.change_rate, options.change_rate);
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_options = options;
+    m_options.max_attempts = std::max(1u, m_options.max_attempts);
+    m_read = read;
+    m_change = change;
+}
+
+RateLimiter::options_t RateLimiter::options()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_options;
+}
+
+void RateLimiter::acquire(kind_t kind)
+{
+    static auto &read_wait = metrics::histogram("dnskeeper_route53_limiter_wait_seconds",
+                                                "Time Route53 calls waited for the rate limiter",
+                                                {{"bucket", "read"}});
+    static auto &change_wait = metrics::histogram("dnskeeper_route53_limiter_wait_seconds",
+                                                  "Time Route53 calls waited for the rate limiter",
+                                                  {{"bucket", "change"}});
+
+    std::shared_ptr<TokenBucket> bucket;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        bucket = (kind == kind_t::READ) ? m_read : m_change;
+    }
+    auto wait = bucket->acquire();
+    (kind == kind_t::READ ? read_wait : change_wait).observe(wait);
+}
+
+std::chrono::milliseconds RateLimiter::backoff(std::chrono::milliseconds previous)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto base = std::max(m_options.base_delay.count(), 1L);
+    auto high = std::max(base, 3 * previous.count());
+    auto delay = std::uniform_int_distribution<long>(base, high)(m_rng);
+    return std::chrono::milliseconds(std::min<long>(delay, m_options.max_delay.count()));
+}
@@ -0,0 +1,128 @@
+#include <dnskeeper.h>
+#include <Reconciler.hpp>
+
+#include <string_view>
+#include <unordered_map>
+
+Reconciler::table_t::table_t(size_t count)
+{
+    // At most half full
+    size_t capacity = 16;
+    m_shift = 60;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+        m_shift--;
+    }
+    m_keys.resize(capacity);
+    m_values.assign(capacity, empty);
+}
+
+size_t Reconciler::table_t::slot(const key_t &key) const
+{
+    // Fibonacci hashing, the top bits are the best mixed
+    uint64_t h = key.ip.hash() ^ key.name;
+    return (h * 0x9E3779B97F4A7C15ull) >> m_shift;
+}
+
+bool Reconciler::table_t::insert(const key_t &key, uint32_t value)
+{
+    size_t mask = m_keys.size() - 1;
+    for (size_t i = slot(key);; i = (i + 1) & mask)
+    {
+        if (m_values[i] == empty)
+        {
+            m_keys[i] = key;
+            m_values[i] = value;
+            return true;
+        }
+        if (m_keys[i] == key)
+            return false;
+    }
+}
+
+bool Reconciler::table_t::find(const key_t &key, uint32_t &value) const
+{
+    size_t mask = m_keys.size() - 1;
+    for (size_t i = slot(key);; i = (i + 1) & mask)
+    {
+        if (m_values[i] == empty)
+            return false;
+        if (m_keys[i] == key)
+        {
+            value = m_values[i];
+            return true;
+        }
+    }
+}
+
+Reconciler::Reconciler(const DnsHandler::records_t &records,
+                       const SrvCache::records_t &servers,
+                       const std::string &domain_name)
+    : m_next(servers.size(), npos),
+      m_published(servers.size(), false)
+{
+    // Names are interned by view, the strings belong to the
+    // inputs and are not needed afterwards
+    std::unordered_map<std::string_view, uint32_t> names;
+    auto intern = [&names](std::string_view s) {
+        return names.emplace(s, static_cast<uint32_t>(names.size())).first->second;
+    };
+
+    size_t count = 0;
+    for (const auto &row : records)
+        count += std::get<DnsHandler::IP_LIST>(row).size();
+    m_addresses.reserve(count);
+    names.reserve(records.size());
+    table_t table(count);
+
+    // Published side: <subdomain>.<domain_name> records
+    for (size_t r = 0; r < records.size(); r++)
+    {
+        const auto &name = std::get<DnsHandler::DOMAIN>(records[r]);
+        const auto &ips = std::get<DnsHandler::IP_LIST>(records[r]);
+        bool in_domain = name.size() > domain_name.size() + 1 &&
+                         name[name.size() - domain_name.size() - 1] == '.' &&
+                         name.compare(name.size() - domain_name.size(),
+                                      domain_name.size(), domain_name) == 0;
+        uint32_t id = 0;
+        if (in_domain)
+            id = intern(std::string_view(name).substr(0, name.size() - domain_name.size() - 1));
+
+        for (size_t i = 0; i < ips.size(); i++)
+        {
+            m_addresses.push_back({r, i});
+            if (in_domain) // Others can't belong to a server
+                table.insert({ips[i], id}, m_addresses.size() - 1);
+        }
+    }
+
+    // Desired side: every server, in inventory order
+    std::vector<size_t> last(m_addresses.size(), npos);
+    for (size_t s = 0; s < servers.size(); s++)
+    {
+        const auto &row = servers[s];
+        auto name = names.find(row[SrvCache::SUBDOMAIN]);
+        if (name == names.end())
+            continue;
+
+        // Invalid addresses can't be published
+        IpAddr ip;
+        uint32_t address = 0;
+        if (!IpAddr::parse(row[SrvCache::IP_ADDR], ip) ||
+            !table.find({ip, name->second}, address))
+            continue;
+
+        m_published[s] = true;
+        m_present++;
+        if (last[address] == npos)
+            m_addresses[address].server = s;
+        else
+            m_next[last[address]] = s;
+        last[address] = s;
+    }
+
+    for (const auto &address : m_addresses)
+        if (address.server == npos)
+            m_extra++;
+}
@@ -0,0 +1,309 @@
+#include <dnskeeper.h>
+#include <Route53Emulator.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace {
+
+std::string fqdn(std::string name)
+{
+    if (name.empty() || name.back() != '.')
+        name += '.';
+    return name;
+}
+
+// Route53 treats a record set as equal when TTL and values match,
+// regardless of the value order
+bool same_values(const Model::ResourceRecordSet &a, const Model::ResourceRecordSet &b)
+{
+    auto values = [](const Model::ResourceRecordSet &r) {
+        std::vector<std::string> v;
+        for (const auto &rr : r.GetResourceRecords())
+            v.push_back(rr.GetValue());
+        std::sort(v.begin(), v.end());
+        return v;
+    };
+    return a.GetTTL() == b.GetTTL() && values(a) == values(b);
+}
+
+// True if name is the zone apex or below it. Both are FQDNs
+bool in_zone(const std::string &name, const std::string &zone)
+{
+    return name.size() >= zone.size()
+           && name.compare(name.size() - zone.size(), zone.size(), zone) == 0
+           && (name.size() == zone.size() || name[name.size() - zone.size() - 1] == '.');
+}
+
+Model::Route53Error error(Route53Errors type, const std::string &name,
+                          const std::string &message, bool retry = false)
+{
+    return Model::Route53Error(type, name, message, retry);
+}
+
+} // anonymous namespace (private)
+
+const std::string Route53Emulator::zone_id = "Z0EMULATED";
+
+int Route53Emulator::compare_names(const std::string &a, const std::string &b)
+{
+    // Walk both names label by label from the right
+    size_t end_a = a.size(), end_b = b.size();
+    if (end_a > 0 && a[end_a - 1] == '.')
+        end_a--;
+    if (end_b > 0 && b[end_b - 1] == '.')
+        end_b--;
+    while (end_a > 0 && end_b > 0)
+    {
+        auto dot_a = a.rfind('.', end_a - 1);
+        auto dot_b = b.rfind('.', end_b - 1);
+        size_t start_a = (dot_a == std::string::npos) ? 0 : dot_a + 1;
+        size_t start_b = (dot_b == std::string::npos) ? 0 : dot_b + 1;
+        int c = a.compare(start_a, end_a - start_a, b, start_b, end_b - start_b);
+        if (c != 0)
+            return c;
+        end_a = (dot_a == std::string::npos) ? 0 : dot_a;
+        end_b = (dot_b == std::string::npos) ? 0 : dot_b;
+    }
+    return (end_a > 0) - (end_b > 0);
+}
+
+Route53Emulator::Route53Emulator(const options_t &options)
+    : m_options(options),
+      m_rng(std::random_device{}())
+{
+    m_zones[zone_id] = {fqdn(m_options.domain), false, {}};
+    for (size_t i = 0; i < m_options.private_zones.size(); i++)
+        m_zones["Z" + std::to_string(i + 1) + "EMULATED"] = {fqdn(m_options.private_zones[i]), true, {}};
+}
+
+size_t Route53Emulator::size()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    size_t count = 0;
+    for (const auto &zone : m_zones)
+        count += zone.second.rrsets.size();
+    return count;
+}
+
+size_t Route53Emulator::change_calls()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_change_calls;
+}
+
+size_t Route53Emulator::max_in_flight()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return std::exchange(m_max_in_flight, m_in_flight);
+}
+
+bool Route53Emulator::throttled()
+{
+    auto delay = m_options.latency;
+    bool throttle = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_options.jitter.count() > 0)
+            delay += std::chrono::milliseconds(
+                std::uniform_int_distribution<long>(0, m_options.jitter.count())(m_rng));
+        if (m_options.throttle_rate > 0)
+            throttle = std::bernoulli_distribution(m_options.throttle_rate)(m_rng);
+        m_max_in_flight = std::max(m_max_in_flight, ++m_in_flight);
+    }
+    if (delay.count() > 0)
+        std::this_thread::sleep_for(delay);
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_in_flight--;
+    return throttle;
+}
+
+Model::ListHostedZonesByNameOutcome
+Route53Emulator::ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request)
+{
+    if (throttled())
+        return error(Route53Errors::THROTTLING, "Throttling", "Rate exceeded", true);
+
+    // Listed from DNSName on, ordered by name, then by id. Every zone
+    // fits in one page
+    const auto &start = request.GetDNSName();
+    Aws::Vector<Model::HostedZone> zones;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (const auto &entry : m_zones)
+        {
+            if (compare_names(entry.second.name, start) < 0)
+                continue;
+
+            Model::HostedZone zone;
+            zone.SetId("/hostedzone/" + entry.first);
+            zone.SetName(entry.second.name);
+            zone.SetConfig(Model::HostedZoneConfig().WithPrivateZone(entry.second.private_zone));
+            zone.SetResourceRecordSetCount(entry.second.rrsets.size());
+            zones.push_back(zone);
+        }
+    }
+    std::stable_sort(zones.begin(), zones.end(), [](const auto &a, const auto &b) {
+        return compare_names(a.GetName(), b.GetName()) < 0;
+    });
+
+    Model::ListHostedZonesByNameResult result;
+    result.SetHostedZones(zones);
+    result.SetIsTruncated(false);
+    return result;
+}
+
+Model::ListResourceRecordSetsOutcome
+Route53Emulator::ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request)
+{
+    if (throttled())
+        return error(Route53Errors::THROTTLING, "Throttling", "Rate exceeded", true);
+
+    auto id = request.GetHostedZoneId();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto zone = m_zones.find(id.substr(id.rfind('/') + 1));
+    if (zone == m_zones.end())
+        return error(Route53Errors::NO_SUCH_HOSTED_ZONE, "NoSuchHostedZone", "No hosted zone " + id);
+    const auto &rrsets = zone->second.rrsets;
+
+    long requested = m_options.max_items;
+    if (!request.GetMaxItems().empty())
+        cast(request.GetMaxItems(), requested);
+    size_t max_items = std::min(static_cast<size_t>(std::max(1L, requested)), m_options.max_items);
+
+    Model::ListResourceRecordSetsResult result;
+    auto it = rrsets.begin();
+    if (request.StartRecordNameHasBeenSet())
+        it = rrsets.lower_bound({fqdn(request.GetStartRecordName()),
+                                   request.StartRecordTypeHasBeenSet()
+                                       ? request.GetStartRecordType()
+                                       : Model::RRType::NOT_SET});
+
+    Aws::Vector<Model::ResourceRecordSet> page;
+    for (; it != rrsets.end() && page.size() < max_items; ++it)
+        page.push_back(it->second);
+    result.SetResourceRecordSets(page);
+    result.SetMaxItems(std::to_string(max_items));
+    result.SetIsTruncated(it != rrsets.end());
+    if (it != rrsets.end())
+    {
+        result.SetNextRecordName(it->first.first);
+        result.SetNextRecordType(it->first.second);
+    }
+    return result;
+}
+
+Model::ChangeResourceRecordSetsOutcome
+Route53Emulator::ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_change_calls++;
+    }
+    if (throttled())
+        return error(Route53Errors::THROTTLING, "Throttling", "Rate exceeded", true);
+
+    const auto &changes = request.GetChangeBatch().GetChanges();
+    if (changes.empty() || changes.size() > 1000)
+        return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                     "A change batch holds 1 to 1000 changes");
+
+    // Value limits, an UPSERT counts each value twice
+    size_t records = 0;
+    size_t chars = 0;
+    for (const auto &chg : changes)
+    {
+        size_t weight = (chg.GetAction() == Model::ChangeAction::UPSERT) ? 2 : 1;
+        for (const auto &rr : chg.GetResourceRecordSet().GetResourceRecords())
+        {
+            records += weight;
+            chars += weight * rr.GetValue().length();
+        }
+    }
+    if (records > 1000 || chars > 32000)
+        return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                     "A change batch holds at most 1000 values and 32000 characters");
+
+    auto id = request.GetHostedZoneId();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto zone = m_zones.find(id.substr(id.rfind('/') + 1));
+    if (zone == m_zones.end())
+        return error(Route53Errors::NO_SUCH_HOSTED_ZONE, "NoSuchHostedZone", "No hosted zone " + id);
+
+    // The batch applies entirely or not at all
+    auto rrsets = zone->second.rrsets;
+    for (const auto &chg : changes)
+    {
+        auto rrs = chg.GetResourceRecordSet();
+        rrs.SetName(fqdn(rrs.GetName()));
+        key_t key{rrs.GetName(), rrs.GetType()};
+        if (!in_zone(key.first, zone->second.name))
+            return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                         "RRSet with DNS name " + key.first +
+                         " is not permitted in zone " + zone->second.name);
+        auto it = rrsets.find(key);
+        switch (chg.GetAction())
+        {
+            case Model::ChangeAction::CREATE:
+                if (it != rrsets.end())
+                    return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                                 "Tried to create resource record set " + key.first +
+                                 " but it already exists");
+                [[fallthrough]];
+            case Model::ChangeAction::UPSERT:
+                if (rrs.GetResourceRecords().empty())
+                    return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                                 "Resource record set " + key.first + " has no values");
+                rrsets[key] = rrs;
+                break;
+
+            case Model::ChangeAction::DELETE_:
+                if (it == rrsets.end() || !same_values(it->second, rrs))
+                    return error(Route53Errors::INVALID_CHANGE_BATCH, "InvalidChangeBatch",
+                                 "Tried to delete resource record set " + key.first +
+                                 " but it was not found");
+                rrsets.erase(it);
+                break;
+
+            default:
+                return error(Route53Errors::INVALID_INPUT, "InvalidInput", "Unknown change action");
+        }
+    }
+    zone->second.rrsets.swap(rrsets);
+
+    auto change = "C" + std::to_string(m_next_change++);
+    m_changes[change] = std::chrono::steady_clock::now() + m_options.insync_delay;
+
+    Model::ChangeInfo info;
+    info.SetId("/change/" + change);
+    info.SetStatus(Model::ChangeStatus::PENDING);
+    info.SetComment(request.GetChangeBatch().GetComment());
+    Model::ChangeResourceRecordSetsResult result;
+    result.SetChangeInfo(info);
+    return result;
+}
+
+Model::GetChangeOutcome
+Route53Emulator::GetChange(const Model::GetChangeRequest &request)
+{
+    if (throttled())
+        return error(Route53Errors::THROTTLING, "Throttling", "Rate exceeded", true);
+
+    auto id = request.GetId();
+    id = id.substr(id.rfind('/') + 1);
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_changes.find(id);
+    if (it == m_changes.end())
+        return error(Route53Errors::NO_SUCH_CHANGE, "NoSuchChange", "No change " + id);
+
+    Model::ChangeInfo info;
+    info.SetId("/change/" + id);
+    info.SetStatus(std::chrono::steady_clock::now() >= it->second
+                       ? Model::ChangeStatus::INSYNC
+                       : Model::ChangeStatus::PENDING);
+    Model::GetChangeResult result;
+    result.SetChangeInfo(info);
+    return result;
+}
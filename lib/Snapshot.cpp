@@ -0,0 +1,256 @@
+#include <dnskeeper.h>
+#include <Snapshot.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Native byte order, the file never leaves the host (or its image)
+const char magic[8] = {'D', 'N', 'S', 'K', 'S', 'N', 'A', 'P'};
+const uint32_t format = 2;
+const uint32_t byte_order = 0x01020304;
+
+struct header_t
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t byte_order;
+    int64_t saved_ms;   // Unix time
+    char domain[256];   // DOMAIN_NAME of the writer, NUL padded
+    uint64_t records;
+    uint64_t servers;
+    uint64_t checksum;  // FNV-1a of the payload
+};
+
+uint64_t fnv1a(const char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void put(std::string &out, const std::string &text)
+{
+    put<uint32_t>(out, text.size());
+    out += text;
+}
+
+// Bounds-checked reads over the mapping. Once a read falls short every
+// later one fails too
+struct reader_t
+{
+    const char *pos;
+    const char *end;
+    bool ok = true;
+
+    template <typename T>
+    T get()
+    {
+        T value = {};
+        if (!ok || static_cast<size_t>(end - pos) < sizeof(T))
+        {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    std::string text()
+    {
+        auto size = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - pos) < size)
+        {
+            ok = false;
+            return "";
+        }
+        std::string value(pos, size);
+        pos += size;
+        return value;
+    }
+};
+
+bool write_all(int fd, const std::string &data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        auto n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+} // anonymous namespace (private)
+
+namespace snapshot {
+
+bool save(const std::string &path,
+          const std::string &domain,
+          const DnsHandler::zone_t &zone,
+          const SrvCache::inventory_t &inventory)
+{
+    header_t header = {};
+    if (domain.size() >= sizeof(header.domain))
+    {
+        LOG(WARNING) << "Snapshot " << path << " not saved: domain name too long\n";
+        return false;
+    }
+
+    std::string payload;
+    payload.reserve(64 * (zone.records.size() + inventory.servers.size()));
+    for (const auto &row : zone.records)
+    {
+        put(payload, std::get<DnsHandler::DOMAIN>(row));
+        put<int64_t>(payload, std::get<DnsHandler::TTL>(row));
+        put<char>(payload, std::get<DnsHandler::TYPE>(row));
+        const auto &ips = std::get<DnsHandler::IP_LIST>(row);
+        put<uint32_t>(payload, ips.size());
+        for (const auto &ip : ips)
+            payload.append(reinterpret_cast<const char *>(ip.bytes().data()), ip.bytes().size());
+    }
+    for (const auto &server : inventory.servers)
+    {
+        put<int64_t>(payload, server.first);
+        put<uint32_t>(payload, server.second.size());
+        for (const auto &col : server.second)
+            put(payload, col);
+    }
+
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.format = format;
+    header.byte_order = byte_order;
+    header.saved_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+    std::memcpy(header.domain, domain.data(), domain.size());
+    header.records = zone.records.size();
+    header.servers = inventory.servers.size();
+    header.checksum = fnv1a(payload.data(), payload.size());
+
+    std::string file(reinterpret_cast<const char *>(&header), sizeof(header));
+    file += payload;
+
+    // Readers see the old file or the new one, never a partial write
+    auto tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_all(fd, file) && fdatasync(fd) == 0;
+    if (fd >= 0)
+        close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        LOG(WARNING) << "Snapshot " << path << " not saved: " << strerror(errno) << "\n";
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    LOG(TRACE) << "Snapshot saved (" << header.records << " records, "
+               << header.servers << " servers, " << file.size() << " bytes)\n";
+    return true;
+}
+
+bool load(const std::string &path, const std::string &domain, data_t &data)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG(INFO) << "No snapshot at " << path << "\n";
+        return false;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(header_t))
+    {
+        close(fd);
+        LOG(WARNING) << "Snapshot " << path << " is truncated\n";
+        return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        LOG(WARNING) << "Snapshot " << path << " not mapped: " << strerror(errno) << "\n";
+        return false;
+    }
+
+    const char *base = static_cast<const char *>(map);
+    reader_t in{base, base + st.st_size};
+    auto header = in.get<header_t>();
+    bool ok = std::memcmp(header.magic, magic, sizeof(magic)) == 0
+              && header.format == format
+              && header.byte_order == byte_order
+              && header.checksum == fnv1a(in.pos, in.end - in.pos);
+    header.domain[sizeof(header.domain) - 1] = 0;
+    if (ok && domain != header.domain)
+    {
+        munmap(map, st.st_size);
+        LOG(WARNING) << "Snapshot " << path << " belongs to " << header.domain
+                     << ", not " << domain << ", ignored\n";
+        return false;
+    }
+
+    // Counts are bounded by the payload before anything is reserved
+    data_t loaded;
+    if (ok && header.records <= static_cast<uint64_t>(in.end - in.pos)
+        && header.servers <= static_cast<uint64_t>(in.end - in.pos))
+    {
+        loaded.saved = std::chrono::system_clock::time_point(
+            std::chrono::milliseconds(header.saved_ms));
+        loaded.records.reserve(header.records);
+        for (uint64_t i = 0; i < header.records && in.ok; i++)
+        {
+            auto name = in.text();
+            auto ttl = in.get<int64_t>();
+            auto type = in.get<char>();
+            auto count = in.get<uint32_t>();
+            DnsHandler::iplist_t ips;
+            for (uint32_t j = 0; j < count && in.ok; j++)
+            {
+                auto bytes = in.get<std::array<uint8_t, 16>>();
+                ips.push_back(IpAddr::from_bytes(bytes.data()));
+            }
+            loaded.records.emplace_back(name, ips, ttl, type);
+        }
+        for (uint64_t i = 0; i < header.servers && in.ok; i++)
+        {
+            auto id = in.get<int64_t>();
+            auto count = in.get<uint32_t>();
+            SrvCache::row_t row;
+            for (uint32_t j = 0; j < count && in.ok; j++)
+                row.push_back(in.text());
+            loaded.servers[id] = row;
+        }
+        ok = in.ok && in.pos == in.end;
+    }
+    else
+        ok = false;
+    munmap(map, st.st_size);
+
+    if (!ok)
+    {
+        LOG(WARNING) << "Snapshot " << path << " is corrupt, ignored\n";
+        return false;
+    }
+    data = std::move(loaded);
+    LOG(INFO) << "Snapshot loaded (" << data.records.size() << " records, "
+              << data.servers.size() << " servers)\n";
+    return true;
+}
+
+} // namespace snapshot
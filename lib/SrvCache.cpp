@@ -1,5 +1,6 @@
 #include <dnskeeper.h>
 #include <SrvCache.hpp>
+#include <Metrics.hpp>
 
 #include <iostream>
 #include <cassert>
@@ -7,19 +8,27 @@
 #include <string>
 #include <iomanip>
 
-bool SrvCache::test_connection()
-{
-    return m_conn.is_open();
-}
+namespace {
 
-SrvCache::SrvCache(const std::string& url)
-    : m_conn(url)
+// Query latency by the SrvCache operation issuing it. The series are
+// registered once so timing a query never takes the registry lock
+metrics::Histogram &query_latency(const std::string &name)
 {
+    static const auto series = [] {
+        std::map<std::string, metrics::Histogram *> m;
+        for (auto query : {"install_notify", "reload", "apply_change", "servers",
+                           "clusters", "subdomains"})
+            m[query] = &metrics::histogram("dnskeeper_db_query_seconds",
+                                           "Postgres query latency",
+                                           {{"query", query}});
+        return m;
+    }();
+    return *series.at(name);
 }
 
-bool SrvCache::get_servers(records_t &data, const std::string domain, const std::string ip)
-{
-    const std::string prepared_simple = R"(
+// Every query SrvCache issues. They are prepared once on each pooled
+// connection so the hot path only binds parameters (no SQL building)
+const std::string server_columns = R"(
         SELECT A.id as server_id,
             A.ip_string as server_ip,
             A.friendly_name as friendly_name,
@@ -31,80 +40,460 @@ bool SrvCache::get_servers(records_t &data, const std::string domain, const std:
             JOIN cluster B ON A.cluster_id = B.id
         )";
 
-    const std::string prepared_with_subdomain = prepared_simple + R"(
-        WHERE
-            B.subdomain = $1)";
+const char *stmt_servers = "servers";
+const char *stmt_servers_by_subdomain = "servers_by_subdomain";
+const char *stmt_servers_by_subdomain_ip = "servers_by_subdomain_ip";
+const char *stmt_servers_by_subdomains = "servers_by_subdomains";
+const char *stmt_clusters = "clusters";
+const char *stmt_server_by_id = "server_by_id";
+const char *stmt_servers_by_cluster = "servers_by_cluster";
 
-    const std::string prepared_with_subdomain_and_ip = prepared_simple + R"(
+const std::pair<const char *, std::string> statements[] = {
+    {stmt_servers, server_columns},
+    {stmt_servers_by_subdomain, server_columns + R"(
+        WHERE
+            B.subdomain = $1)"},
+    {stmt_servers_by_subdomain_ip, server_columns + R"(
+        WHERE
+            B.subdomain = $1 AND A.ip_string = $2)"},
+    // Note: by ip alone is not useful (same ip could be in multiple subdomains)
+    {stmt_servers_by_subdomains, server_columns + R"(
+        WHERE
+            B.subdomain = ANY($1::text[]))"},
+    {stmt_clusters, "SELECT * from cluster"},
+    // Incremental inventory updates
+    {stmt_server_by_id, server_columns + R"(
         WHERE
-            B.subdomain = $1 AND A.ip_string = $2)";
+            A.id = $1)"},
+    {stmt_servers_by_cluster, server_columns + R"(
+        WHERE
+            B.id = $1)"},
+};
+
+// Row triggers on server and cluster publish "<table>:<op>:<id>"
+const char *notify_channel = "dnskeeper_inventory";
+const char *notify_installed_sql = R"(
+    SELECT count(*) FROM pg_trigger
+        WHERE NOT tgisinternal
+          AND tgrelid IN ('server'::regclass, 'cluster'::regclass)
+          AND tgname IN ('dnskeeper_server_notify', 'dnskeeper_server_truncate',
+                         'dnskeeper_cluster_notify', 'dnskeeper_cluster_truncate'))";
+const long notify_triggers = 4;
+// Run once per database, when any of the triggers is missing
+const char *notify_sql = R"(
+    CREATE OR REPLACE FUNCTION dnskeeper_notify() RETURNS trigger AS $$
+    DECLARE
+        row_id text := '';
+    BEGIN
+        IF TG_LEVEL = 'ROW' THEN
+            IF TG_OP = 'DELETE' THEN
+                row_id := OLD.id;
+            ELSE
+                row_id := NEW.id;
+            END IF;
+        END IF;
+        PERFORM pg_notify('dnskeeper_inventory',
+                          TG_TABLE_NAME || ':' || TG_OP || ':' || row_id);
+        RETURN NULL;
+    END;
+    $$ LANGUAGE plpgsql;
+
+    DROP TRIGGER IF EXISTS dnskeeper_server_notify ON server;
+    CREATE TRIGGER dnskeeper_server_notify
+        AFTER INSERT OR UPDATE OR DELETE ON server
+        FOR EACH ROW EXECUTE PROCEDURE dnskeeper_notify();
+    DROP TRIGGER IF EXISTS dnskeeper_server_truncate ON server;
+    CREATE TRIGGER dnskeeper_server_truncate
+        AFTER TRUNCATE ON server
+        FOR EACH STATEMENT EXECUTE PROCEDURE dnskeeper_notify();
+
+    DROP TRIGGER IF EXISTS dnskeeper_cluster_notify ON cluster;
+    CREATE TRIGGER dnskeeper_cluster_notify
+        AFTER INSERT OR UPDATE OR DELETE ON cluster
+        FOR EACH ROW EXECUTE PROCEDURE dnskeeper_notify();
+    DROP TRIGGER IF EXISTS dnskeeper_cluster_truncate ON cluster;
+    CREATE TRIGGER dnskeeper_cluster_truncate
+        AFTER TRUNCATE ON cluster
+        FOR EACH STATEMENT EXECUTE PROCEDURE dnskeeper_notify();
+    )";
 
-    // Note: prepared_with_ip is not useful (same ip could be in multiple subdomains)
+// Without triggers the inventory falls back to periodic reloads
+const auto fallback_reload = 60s;
 
-    if (m_conn.is_open())
+class receiver : public pqxx::notification_receiver
+{
+private:
+    std::function<void(const std::string &)> m_handler;
+
+public:
+    receiver(pqxx::connection &conn, std::function<void(const std::string &)> handler)
+        : pqxx::notification_receiver(conn, notify_channel),
+          m_handler(handler)
+    {}
+
+    void operator()(const std::string &payload, int) override
     {
-        pqxx::work tx{m_conn};
-        std::string stmt = {};
-        pqxx::params p;
-        if(!domain.empty()) {
-            auto it = domain.find('.');
-            if (it != std::string::npos)
-                p.append(domain.substr(0, it));
-            else
-                p.append(domain);
+        m_handler(payload);
+    }
+};
 
-            if(!ip.empty()) {
-                stmt = prepared_with_subdomain_and_ip;
-                p.append(ip);
-            } else {
-                stmt = prepared_with_subdomain;
-            }
-        } else {
-            stmt = prepared_simple;
-        }
+// Addresses are kept in canonical text so they compare exactly
+// with DNS values. Invalid ones are kept as entered
+std::string canonical_ip(const char *text)
+{
+    IpAddr ip;
+    return IpAddr::parse(text, ip) ? ip.to_string() : text;
+}
 
-        LOG(TRACE) << "Prepared statement with "
-                   << " domain:" << domain << " ip:" << ip
-                   << " [" << stmt << "]\n";
+SrvCache::row_t to_row(const pqxx::row &row)
+{
+    assert(row.size() == SrvCache::MAX_COLS);
+    return {row[SrvCache::SERVER_ID].c_str(),
+            canonical_ip(row[SrvCache::IP_ADDR].c_str()),
+            row[SrvCache::NAME].c_str(),
+            row[SrvCache::CLUSTER_ID].c_str(),
+            row[SrvCache::CLUSTER_NAME].c_str(),
+            row[SrvCache::SUBDOMAIN].c_str()};
+}
+
+} // anonymous namespace (private)
+
+bool SrvCache::test_connection()
+{
+    auto conn = m_pool.acquire();
+    return conn && conn->is_open();
+}
+
+SrvCache::SrvCache(const std::string& url,
+                   size_t pool_size,
+                   std::chrono::milliseconds pool_timeout,
+                   bool listen)
+    : m_url(url),
+      m_pool(url, pool_size, pool_timeout,
+             [](pqxx::connection &conn) {
+                 for (const auto &stmt : statements)
+                     conn.prepare(stmt.first, stmt.second);
+             })
+{
+    // Until the first load completes queries go to the database
+    if (listen)
+        m_listener = std::thread(&SrvCache::listen_loop, this);
+}
+
+SrvCache::~SrvCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_listen_mtx);
+        m_stop = true;
+    }
+    m_listen_cv.notify_all();
+    if (m_listener.joinable())
+        m_listener.join();
+}
+
+void SrvCache::inventory_t::reindex()
+{
+    by_subdomain.clear();
+    by_ip.clear();
+    by_cluster.clear();
+    by_key.clear();
+    for (const auto &entry : servers)
+    {
+        const auto &row = entry.second;
+        by_subdomain[row[SUBDOMAIN]].push_back(entry.first);
+        IpAddr ip;
+        if (IpAddr::parse(row[IP_ADDR], ip))
+            by_ip[ip].push_back(entry.first);
+        by_cluster[row[CLUSTER_ID]].push_back(entry.first);
+        by_key[server_key(row[SUBDOMAIN], row[IP_ADDR])].push_back(entry.first);
+    }
+}
+
+SrvCache::inventory_ptr SrvCache::inventory()
+{
+    std::lock_guard<std::mutex> lock(m_inventory_mtx);
+    return m_inventory;
+}
+
+uint64_t SrvCache::version()
+{
+    auto inv = inventory();
+    return inv ? inv->version : 0;
+}
+
+void SrvCache::publish(std::shared_ptr<inventory_t> inventory)
+{
+    inventory->reindex();
+    std::lock_guard<std::mutex> lock(m_inventory_mtx);
+    inventory->version = (m_inventory ? m_inventory->version : 0) + 1;
+    m_inventory = inventory;
+    LOG(TRACE) << "Server inventory at version " << inventory->version
+               << " (" << inventory->servers.size() << " servers)\n";
+}
+
+bool SrvCache::install_notify()
+{
+    return with_connection("install_notify", [&](pqxx::connection &conn) {
+        pqxx::work tx{conn};
+        if (tx.exec1(notify_installed_sql)[0].as<long>() == notify_triggers)
+            return true;
+        LOG(INFO) << "Installing inventory triggers\n";
+        tx.exec(notify_sql);
+        tx.commit();
+        return true;
+    });
+}
+
+bool SrvCache::seed(const std::map<long, row_t> &servers)
+{
+    auto inv = std::make_shared<inventory_t>();
+    inv->servers = servers;
+    inv->stale = true;
+    inv->reindex();
+
+    std::lock_guard<std::mutex> lock(m_inventory_mtx);
+    if (m_inventory)
+        return false;
+    inv->version = 1;
+    m_inventory = inv;
+    LOG(DEBUG) << "Server inventory seeded (" << servers.size() << " servers)\n";
+    return true;
+}
+
+bool SrvCache::reload()
+{
+    auto inv = std::make_shared<inventory_t>();
+    bool loaded = with_connection("reload", [&](pqxx::connection &conn) {
+        pqxx::work tx{conn};
+        for (auto const &row : tx.exec_prepared(stmt_servers))
+            inv->servers[row[SERVER_ID].as<long>()] = to_row(row);
+        return true;
+    });
+
+    if (loaded)
+        publish(inv);
+    return loaded;
+}
+
+bool SrvCache::apply_change(const std::string &payload)
+{
+    // <table>:<op>:<id>
+    auto first = payload.find(':');
+    auto second = payload.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+    {
+        LOG(WARNING) << "Unexpected inventory notification [" << payload << "]\n";
+        return reload();
+    }
+    auto table = payload.substr(0, first);
+    auto op = payload.substr(first + 1, second - first - 1);
+    long id = 0;
+    if (op == "TRUNCATE" || !cast(payload.substr(second + 1), id) || !inventory())
+        return reload();
 
-        auto r = tx.exec_params(stmt, p);
+    LOG(TRACE) << "Inventory change " << table << " " << op << " " << id << "\n";
 
+    // Only the affected rows are fetched again
+    records_t rows;
+    bool fetched = with_connection("apply_change", [&](pqxx::connection &conn) {
+        pqxx::work tx{conn};
+        auto r = (table == "cluster")
+                     ? tx.exec_prepared(stmt_servers_by_cluster, id)
+                     : tx.exec_prepared(stmt_server_by_id, id);
         for (auto const &row : r)
-        {
-            assert(row.size() == SrvCache::MAX_COLS);
-            data.push_back({row[SrvCache::SERVER_ID].c_str(),
-                            row[SrvCache::IP_ADDR].c_str(),
-                            row[SrvCache::NAME].c_str(),
-                            row[SrvCache::CLUSTER_ID].c_str(),
-                            row[SrvCache::CLUSTER_NAME].c_str(),
-                            row[SrvCache::SUBDOMAIN].c_str()});
-        }
+            rows.push_back(to_row(row));
+        return true;
+    });
+    if (!fetched)
+        return false;
 
-        return data.size() > 0;
+    auto inv = std::make_shared<inventory_t>(*inventory());
+    if (table == "cluster")
+    {
+        // Drop the cluster's servers, the query returns the survivors
+        auto it = inv->by_cluster.find(std::to_string(id));
+        if (it != inv->by_cluster.end())
+            for (auto server_id : it->second)
+                inv->servers.erase(server_id);
     }
+    else
+        inv->servers.erase(id);
 
+    for (auto &row : rows)
+    {
+        long server_id = 0;
+        if (cast(row[SERVER_ID], server_id))
+            inv->servers[server_id] = std::move(row);
+    }
+
+    publish(inv);
+    return true;
+}
+
+void SrvCache::listen_loop()
+{
+    auto stopped = [this](std::chrono::seconds wait) {
+        std::unique_lock<std::mutex> lock(m_listen_mtx);
+        return m_listen_cv.wait_for(lock, wait, [this] { return m_stop; });
+    };
+
+    bool notify = false;
+    do
+    {
+        try {
+            pqxx::connection conn(m_url);
+            if (!notify && !(notify = install_notify()))
+                LOG(WARNING) << "Inventory triggers unavailable, reloading every "
+                             << fallback_reload.count() << "s\n";
+
+            // Listen before loading so no commit falls in between. Any
+            // notification missed while disconnected is covered here
+            receiver rcv(conn, [this](const std::string &payload) {
+                apply_change(payload);
+            });
+            reload();
+
+            auto last_reload = std::chrono::steady_clock::now();
+            while (!stopped(0s))
+            {
+                conn.await_notification(1, 0);
+                if (!notify && std::chrono::steady_clock::now() - last_reload > fallback_reload)
+                {
+                    reload();
+                    last_reload = std::chrono::steady_clock::now();
+                }
+            }
+            return;
+        } catch(const pqxx::failure &x) {
+            LOG(WARNING) << "Inventory listener failed: " << x.what() << "\n";
+        }
+    } while (!stopped(5s));
+}
+
+template <typename F>
+bool SrvCache::with_connection(const char *name, F &&query)
+{
+    static auto &broken = metrics::counter("dnskeeper_db_errors_total",
+                                           "Failed Postgres queries",
+                                           {{"error", "broken_connection"}});
+    static auto &failed = metrics::counter("dnskeeper_db_errors_total",
+                                           "Failed Postgres queries",
+                                           {{"error", "query"}});
+
+    // A connection can break while idle in the pool without
+    // is_open() noticing. Retry once on a fresh connection
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        auto conn = m_pool.acquire();
+        if (!conn)
+            return false;
+
+        try {
+            metrics::Timer timer(query_latency(name));
+            return query(*conn);
+        } catch(const pqxx::broken_connection &x) {
+            LOG(WARNING) << "Database connection lost: " << x.what() << "\n";
+            broken.inc();
+            conn.invalidate();
+        } catch(const pqxx::failure &x) {
+            LOG(ERROR) << "Database query failed: " << x.what() << "\n";
+            failed.inc();
+            return false;
+        }
+    }
     return false;
 }
 
-bool SrvCache::get_clusters(records_t &data)
+std::string SrvCache::subdomain_of(const std::string &domain)
+{
+    return domain.substr(0, domain.find('.'));
+}
+
+std::string SrvCache::server_key(const std::string &subdomain, const std::string &ip)
 {
-    if (m_conn.is_open())
+    // Neither valid subdomains nor IPs carry a '|'
+    IpAddr addr;
+    if (IpAddr::parse(ip, addr))
     {
-        pqxx::work tx{m_conn};
-        auto r = tx.exec("SELECT * from cluster");
+        std::string key = subdomain + "|";
+        addr.append_to(key);
+        return key;
+    }
+    return subdomain + "|" + ip;
+}
 
-        for (auto const &row : r)
+bool SrvCache::get_servers(records_t &data, const std::string domain, const std::string ip)
+{
+    auto inv = inventory();
+    if (inv)
+    {
+        if (domain.empty())
         {
-            assert(row.size() == 3); // Detect schema changes
-            data.push_back({row[0].c_str(),
-                            row[1].c_str(),
-                            row[2].c_str()});
+            for (const auto &entry : inv->servers)
+                data.push_back(entry.second);
+        }
+        else
+        {
+            const auto &index = ip.empty() ? inv->by_subdomain : inv->by_key;
+            auto it = index.find(ip.empty() ? subdomain_of(domain)
+                                            : server_key(subdomain_of(domain), ip));
+            if (it != index.end())
+                for (auto id : it->second)
+                    data.push_back(inv->servers.at(id));
         }
-
         return data.size() > 0;
     }
 
-    return false;
+    auto result = m_queries.run("servers " + domain + " " + ip, [&] {
+        records_t rows;
+        bool ok = with_connection("servers", [&](pqxx::connection &conn) {
+            rows.clear(); // From a broken attempt
+            pqxx::work tx{conn};
+            pqxx::result r;
+            if (domain.empty())
+                r = tx.exec_prepared(stmt_servers);
+            else if (ip.empty())
+                r = tx.exec_prepared(stmt_servers_by_subdomain, subdomain_of(domain));
+            else
+                r = tx.exec_prepared(stmt_servers_by_subdomain_ip, subdomain_of(domain), ip);
+
+            LOG(TRACE) << "Prepared statement with "
+                       << " domain:" << domain << " ip:" << ip << "\n";
+
+            for (auto const &row : r)
+                rows.push_back(to_row(row));
+            return true;
+        });
+        return std::make_pair(ok, std::move(rows));
+    });
+
+    data.insert(data.end(), result.second.begin(), result.second.end());
+    return result.first && data.size() > 0;
+}
+
+bool SrvCache::get_clusters(records_t &data)
+{
+    auto result = m_queries.run("clusters", [&] {
+        records_t rows;
+        bool ok = with_connection("clusters", [&](pqxx::connection &conn) {
+            rows.clear(); // From a broken attempt
+            pqxx::work tx{conn};
+            auto r = tx.exec_prepared(stmt_clusters);
+
+            for (auto const &row : r)
+            {
+                assert(row.size() == 3); // Detect schema changes
+                rows.push_back({row[0].c_str(),
+                                row[1].c_str(),
+                                row[2].c_str()});
+            }
+            return true;
+        });
+        return std::make_pair(ok, std::move(rows));
+    });
+
+    data.insert(data.end(), result.second.begin(), result.second.end());
+    return result.first && data.size() > 0;
 }
 
 bool SrvCache::get_subdomains(const row_t &subdomains, records_t &data)
@@ -112,57 +501,33 @@ bool SrvCache::get_subdomains(const row_t &subdomains, records_t &data)
     if (subdomains.empty())
         return false;
 
-    auto prepared_sql = [](int count) -> auto {
-        std::string sql = R"(
-            SELECT A.id as server_id,
-                A.ip_string as server_ip,
-                A.friendly_name as friendly_name,
-                A.cluster_id as cluster_id,
-                B.name as cluster_name,
-                B.subdomain as cluster_subdomain
-            FROM
-                server A
-                JOIN cluster B ON A.cluster_id = B.id 
-            WHERE
-                B.subdomain IN ()";
-        // Add positional parameters
-        for(auto i = 1; i <= count; i++) {
-            if(i != 1)
-                sql.append(",");
-
-            sql.append("$").append(std::to_string(i));
+    auto inv = inventory();
+    if (inv)
+    {
+        for (const auto &subdomain : subdomains)
+        {
+            auto it = inv->by_subdomain.find(subdomain);
+            if (it != inv->by_subdomain.end())
+                for (auto id : it->second)
+                    data.push_back(inv->servers.at(id));
         }
-        sql.append(")");
-        return sql;
-    };
+        return data.size() > 0;
+    }
 
-    if (m_conn.is_open())
-    {
-        pqxx::work tx{m_conn};
+    return with_connection("subdomains", [&](pqxx::connection &conn) {
+        pqxx::work tx{conn};
 
-        auto stmt = prepared_sql(subdomains.size());
+        // The whole list binds to a single array parameter
         LOG(TRACE) << "Prepared statement with "
-                   << subdomains.size() 
-                   << " parameters [" << stmt << "]\n";
+                   << subdomains.size()
+                   << " subdomains\n";
 
-        pqxx::params p;
-        p.append_multi(subdomains);
-        auto r = tx.exec_params(stmt, p);
+        auto r = tx.exec_prepared(stmt_servers_by_subdomains, subdomains);
 
         for (auto const &row : r)
-        {
-            assert(row.size() == SrvCache::MAX_COLS);
-            data.push_back({row[SrvCache::SERVER_ID].c_str(),
-                            row[SrvCache::IP_ADDR].c_str(),
-                            row[SrvCache::NAME].c_str(),
-                            row[SrvCache::CLUSTER_ID].c_str(),
-                            row[SrvCache::CLUSTER_NAME].c_str(),
-                            row[SrvCache::SUBDOMAIN].c_str()});
-        }
+            data.push_back(to_row(row));
         tx.commit();
 
         return data.size() > 0;
-    }
-
-    return false;
-}
\ No newline at end of file
+    });
+}
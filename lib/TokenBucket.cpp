@@ -0,0 +1,54 @@
+#include <dnskeeper.h>
+#include <TokenBucket.hpp>
+
+#include <algorithm>
+#include <thread>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : m_rate(rate),
+      m_burst(std::max(burst, 1.0)),
+      m_tokens(m_burst),
+      m_updated(clock_t::now())
+{
+}
+
+void TokenBucket::refill(clock_t::time_point now)
+{
+    std::chrono::duration<double> elapsed = now - m_updated;
+    m_tokens = std::min(m_burst, m_tokens + elapsed.count() * m_rate);
+    m_updated = now;
+}
+
+TokenBucket::clock_t::duration TokenBucket::acquire()
+{
+    if (m_rate <= 0)
+        return clock_t::duration::zero();
+
+    clock_t::duration wait = clock_t::duration::zero();
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        refill(clock_t::now());
+        m_tokens -= 1;
+        if (m_tokens < 0)
+            wait = std::chrono::duration_cast<clock_t::duration>(
+                std::chrono::duration<double>(-m_tokens / m_rate));
+    }
+
+    // The token is ours, later callers queue up behind it
+    if (wait > clock_t::duration::zero())
+        std::this_thread::sleep_for(wait);
+    return wait;
+}
+
+bool TokenBucket::try_acquire()
+{
+    if (m_rate <= 0)
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    refill(clock_t::now());
+    if (m_tokens < 1)
+        return false;
+    m_tokens -= 1;
+    return true;
+}
@@ -0,0 +1,169 @@
+#include <dnskeeper.h>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <random>
+
+#include <httplib.h>
+
+// Load driver. Requests /dns, /servers, /add and /remove from
+// concurrent clients for a fixed time, then reports throughput and
+// tail latency per endpoint. Point it at an instance started with
+// DNS_PROVIDER=emulator to avoid touching Route53
+
+namespace {
+
+enum endpoint_t
+{
+    DNS = 0,
+    SERVERS,
+    ADD,
+    REMOVE,
+    MAX_ENDPOINT
+};
+const char *endpoint_names[] = {"/dns", "/servers", "/add", "/remove"};
+
+// Share of requests per endpoint (percent)
+const unsigned endpoint_mix[] = {40, 30, 15, 15};
+
+struct stats_t
+{
+    std::vector<std::chrono::microseconds> latency[MAX_ENDPOINT];
+    size_t errors[MAX_ENDPOINT] = {};
+};
+
+double percentile(const std::vector<std::chrono::microseconds> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[rank].count() / 1000.0;
+}
+
+void client(const std::string &host, int port, const std::string &domain,
+            unsigned id, unsigned subdomains,
+            std::chrono::steady_clock::time_point deadline, stats_t &stats)
+{
+    httplib::Client cli(host.c_str(), port);
+    cli.set_keep_alive(true);
+    std::mt19937 rng(id);
+    std::uniform_int_distribution<unsigned> pick(0, 99);
+    std::uniform_int_distribution<unsigned> subdomain(0, std::max(1u, subdomains) - 1);
+
+    // Addresses this client added and can remove again
+    std::deque<std::pair<std::string, std::string>> added;
+    unsigned next_ip = 0;
+
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        unsigned roll = pick(rng);
+        int ep = 0;
+        while (ep < MAX_ENDPOINT - 1 && roll >= endpoint_mix[ep])
+            roll -= endpoint_mix[ep++];
+        if (ep == REMOVE && added.empty())
+            ep = ADD;
+
+        std::string path = endpoint_names[ep];
+        std::string expect;
+        if (ep == ADD)
+        {
+            auto name = "load" + std::to_string(subdomain(rng)) + "." + domain;
+            next_ip++;
+            auto ip = "10.200." + std::to_string(id % 256) + "." + std::to_string(next_ip % 254 + 1);
+            path += "?domain=" + name + "&ip=" + ip;
+            added.emplace_back(name, ip);
+            expect = "ADD_OK";
+        }
+        else if (ep == REMOVE)
+        {
+            auto rec = added.front();
+            added.pop_front();
+            path += "?domain=" + rec.first + "&ip=" + rec.second;
+            expect = "DEL_OK";
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto res = cli.Get(path.c_str());
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        stats.latency[ep].push_back(elapsed);
+        if (!res || res->status != 200 || res->body.compare(0, expect.size(), expect) != 0)
+            stats.errors[ep]++;
+    }
+}
+
+} // anonymous namespace (private)
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <host> <port> <domain> [seconds=30] [clients=8] [subdomains=16]\n";
+        return -1;
+    }
+
+    std::string host = argv[1];
+    int port = 0;
+    unsigned seconds = 30, clients = 8, subdomains = 16;
+    if (!cast(argv[2], port) ||
+        (argc > 4 && !cast(argv[4], seconds)) ||
+        (argc > 5 && !cast(argv[5], clients)) ||
+        (argc > 6 && !cast(argv[6], subdomains)))
+    {
+        std::cerr << "Invalid arguments\n";
+        return -1;
+    }
+    std::string domain = argv[3];
+
+    std::cout << "Running " << clients << " clients against " << host << ":" << port
+              << " for " << seconds << "s\n";
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(seconds);
+    std::vector<stats_t> stats(clients);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < clients; i++)
+        threads.emplace_back(client, host, port, domain, i, subdomains, deadline, std::ref(stats[i]));
+    for (auto &t : threads)
+        t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(10) << "endpoint"
+              << std::right << std::setw(10) << "requests"
+              << std::setw(8) << "errors"
+              << std::setw(10) << "req/s"
+              << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms"
+              << std::setw(10) << "max ms" << "\n";
+
+    size_t total = 0, errors = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (int ep = 0; ep < MAX_ENDPOINT; ep++)
+    {
+        std::vector<std::chrono::microseconds> latency;
+        size_t failed = 0;
+        for (const auto &s : stats)
+        {
+            latency.insert(latency.end(), s.latency[ep].begin(), s.latency[ep].end());
+            failed += s.errors[ep];
+        }
+        std::sort(latency.begin(), latency.end());
+        total += latency.size();
+        errors += failed;
+
+        std::cout << std::left << std::setw(10) << endpoint_names[ep]
+                  << std::right << std::setw(10) << latency.size()
+                  << std::setw(8) << failed
+                  << std::setw(10) << latency.size() / elapsed
+                  << std::setw(10) << percentile(latency, 0.50)
+                  << std::setw(10) << percentile(latency, 0.99)
+                  << std::setw(10) << percentile(latency, 1.0) << "\n";
+    }
+    std::cout << "total " << total << " requests, " << errors << " errors, "
+              << total / elapsed << " req/s\n";
+    return errors ? 1 : 0;
+}
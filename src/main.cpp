@@ -1,12 +1,20 @@
 #include <dnskeeper.h>
 #include <iostream>
+#include <sstream>
 
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 
 #include <SrvCache.hpp>
 #include <DnsHandler.hpp>
+#include <Route53Emulator.hpp>
 #include <Display.hpp>
+#include <PageCache.hpp>
+#include <Api.hpp>
+#include <Pages.hpp>
+#include <Metrics.hpp>
+#include <Prober.hpp>
+#include <Snapshot.hpp>
 
 int main(int argc, char **argv)
 {
@@ -29,136 +37,461 @@ int main(int argc, char **argv)
         LOG(FATAL) << "DATABASE_URL invalid or not set\n";
         exit(-1);
     }
-    SrvCache sc(con_str);
-    if (sc.test_connection())
-        LOG(DEBUG) << "Database connection succeeded\n";
-
     std::string domain_name = "";
     if(!secure_config("DOMAIN_NAME", domain_name)) {
         LOG(FATAL) << "DOMAIN_NAME invalid or not set\n";
         exit(-1);
     }
-    DnsHandler dns(domain_name);
+    // DNS_SNAPSHOT=<file> starts from the data saved by the previous run
+    std::string snapshot_path;
+    unsigned snapshot_interval = 60;
+    secure_config("DNS_SNAPSHOT", snapshot_path, 255);
+    secure_config("DNS_SNAPSHOT_INTERVAL", snapshot_interval);
+    snapshot::data_t saved;
+    bool warm = !snapshot_path.empty() && snapshot::load(snapshot_path, domain_name, saved);
 
-    httplib::Server svr;
-    std::mutex render_mtx;  // protects g_i
+    unsigned pool_size = 4;
+    secure_config("DB_POOL_SIZE", pool_size);
+    SrvCache sc(con_str, pool_size);
+    if (warm)
+        sc.seed(saved.servers);
+    else if (sc.test_connection())
+        LOG(DEBUG) << "Database connection succeeded\n";
+
+    unsigned refresh_interval = 30;
+    secure_config("DNS_REFRESH_INTERVAL", refresh_interval);
+    unsigned write_window = 50;
+    secure_config("DNS_WRITE_WINDOW", write_window);
+    unsigned zone_rate = 5;
+    secure_config("DNS_ZONE_RATE", zone_rate);
 
-    auto ret = svr.set_mount_point("/", "./www");
-    if (!ret) {
-        LOG(ERROR) << "Mount point www not found in current working directory " 
-                   << std::filesystem::current_path() << "\n";
+    // Every Route53 call in the process shares these budgets
+    RateLimiter::options_t limits;
+    unsigned read_rate = 4, change_rate = 1, attempts = 6;
+    secure_config("DNS_READ_RATE", read_rate);
+    secure_config("DNS_CHANGE_RATE", change_rate);
+    secure_config("DNS_MAX_ATTEMPTS", attempts);
+    limits.read_rate = read_rate;
+    limits.change_rate = change_rate;
+    limits.max_attempts = attempts;
+    RateLimiter::process().configure(limits);
+
+    // DNS_PROVIDER=emulator serves the zone from memory (load testing)
+    std::shared_ptr<DnsProvider> provider;
+    std::string provider_name = "route53";
+    secure_config("DNS_PROVIDER", provider_name);
+    if (provider_name == "emulator")
+    {
+        Route53Emulator::options_t options;
+        options.domain = domain_name;
+        unsigned latency = 0, jitter = 0, throttle = 0, insync = 0;
+        secure_config("DNS_EMULATOR_LATENCY", latency);
+        secure_config("DNS_EMULATOR_JITTER", jitter);
+        secure_config("DNS_EMULATOR_THROTTLE", throttle);
+        secure_config("DNS_EMULATOR_INSYNC", insync);
+        options.latency = std::chrono::milliseconds(latency);
+        options.jitter = std::chrono::milliseconds(jitter);
+        options.throttle_rate = std::min(throttle, 100u) / 100.0;
+        options.insync_delay = std::chrono::milliseconds(insync);
+
+        // Comma separated private zones, e.g. ca.example.com,us.example.com
+        std::string zones;
+        secure_config("DNS_EMULATOR_ZONES", zones);
+        std::stringstream zone_list(zones);
+        for (std::string zone; std::getline(zone_list, zone, ',');)
+            if (!zone.empty())
+                options.private_zones.push_back(zone);
+        provider = std::make_shared<Route53Emulator>(options);
+        LOG(WARNING) << "Using the Route53 emulator, no DNS changes are published\n";
+    }
+    else if (provider_name != "route53")
+    {
+        LOG(FATAL) << "DNS_PROVIDER must be route53 or emulator\n";
         exit(-1);
-    } 
-    svr.Get("/dns", [&](const httplib::Request &, httplib::Response &res)
+    }
+    DnsHandler::snapshot_t seed;
+    if (warm)
+    {
+        auto zone = std::make_shared<DnsHandler::zone_t>();
+        DnsHandler::load_records(*zone, saved.records);
+        zone->fetched = saved.saved;
+        seed = zone;
+    }
+    DnsHandler dns(domain_name,
+                   std::chrono::seconds(std::max(1u, refresh_interval)),
+                   std::chrono::milliseconds(write_window),
+                   zone_rate,
+                   provider,
+                   seed);
+
+    // DNS_JOURNAL=<file> makes record changes survive a restart
+    std::string journal_path;
+    if (secure_config("DNS_JOURNAL", journal_path, 255) && !journal_path.empty())
+        dns.resume(std::make_shared<Journal>(journal_path));
+
+    // PROBE_CHECK=tcp|http pulls unresponsive servers out of DNS
+    std::unique_ptr<Prober> prober;
+    std::string probe_check = "off";
+    secure_config("PROBE_CHECK", probe_check);
+    if (probe_check == "tcp" || probe_check == "http")
+    {
+        Prober::options_t options;
+        options.check = (probe_check == "http") ? Prober::check_t::HTTP : Prober::check_t::TCP;
+        unsigned port = 80, interval = 10, timeout = 2000, rise = 2, fall = 3, max_pulled = 1;
+        secure_config("PROBE_PORT", port);
+        secure_config("PROBE_PATH", options.path);
+        secure_config("PROBE_INTERVAL", interval);
+        secure_config("PROBE_TIMEOUT", timeout);
+        secure_config("PROBE_RISE", rise);
+        secure_config("PROBE_FALL", fall);
+        secure_config("PROBE_MAX_PULLED", max_pulled);
+        options.port = static_cast<uint16_t>(port);
+        options.interval = std::chrono::seconds(std::max(1u, interval));
+        options.timeout = std::chrono::milliseconds(std::max(1u, timeout));
+        options.rise = std::max(1u, rise);
+        options.fall = std::max(1u, fall);
+        options.max_pulled = max_pulled;
+
+        prober = std::make_unique<Prober>(options,
+            [&](Prober::targets_t &targets)
             {
-                DnsUI ui;
-                DnsHandler::records_t data;
-                LOG(TRACE) << "Requested DNS Page\n";
+                auto add = [&](const SrvCache::row_t &row) {
+                    IpAddr ip;
+                    if (IpAddr::parse(row[SrvCache::IP_ADDR], ip))
+                        targets.push_back({row[SrvCache::SUBDOMAIN] + "." + domain_name, ip});
+                };
+                auto inventory = sc.inventory();
+                if (inventory)
+                {
+                    for (const auto &server : inventory->servers)
+                        add(server.second);
+                    return true;
+                }
+                SrvCache::records_t servers;
+                if (!sc.get_servers(servers))
+                    return false;
+                for (const auto &server : servers)
+                    add(server);
+                return true;
+            },
+            [&](Prober::rotations_t &changes)
+            {
+                DnsHandler::mutations_t ops;
+                for (const auto &chg : changes)
+                    ops.push_back({chg.name, chg.ip.to_string(),
+                                   chg.pull ? DnsHandler::action_t::REMOVE
+                                            : DnsHandler::action_t::ADD});
+                dns.apply(ops);
+                for (size_t i = 0; i < ops.size(); i++)
+                    changes[i].ok = ops[i].ok;
+            });
+        LOG(INFO) << "Health probes (" << probe_check << ") on port " << port
+                  << " every " << options.interval.count() << "s\n";
+    }
+    else if (probe_check != "off")
+    {
+        LOG(FATAL) << "PROBE_CHECK must be off, tcp or http\n";
+        exit(-1);
+    }
+
+    httplib::Server svr;
+
+    // Latency and concurrency of every endpoint
+    auto instrument = [](const std::string &endpoint, httplib::Server::Handler handler)
+    {
+        auto &latency = metrics::histogram("dnskeeper_http_request_seconds",
+                                           "HTTP request handling time",
+                                           {{"endpoint", endpoint}});
+        auto &in_flight = metrics::gauge("dnskeeper_http_requests_in_flight",
+                                         "HTTP requests being handled",
+                                         {{"endpoint", endpoint}});
+        return [&latency, &in_flight, handler](const httplib::Request &req, httplib::Response &res)
+        {
+            metrics::InFlight guard(in_flight);
+            metrics::Timer timer(latency);
+            handler(req, res);
+        };
+    };
 
-                if (dns.list_records(data))
+    // Static files are embedded in the binary
+    svr.Get(R"(/([\w\-]+\.(?:html|css))?)", instrument("static", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                std::string name = req.matches[1];
+                const asset_t *asset = find_asset(name.empty() ? "index.html" : name);
+                if (!asset)
                 {
-                    // DNS records 
-                    // name|IP list|TTL|type
-                    for (const auto &row : data)
-                    {
-                        auto domain = std::get<DnsHandler::DOMAIN>(row);
-                        auto iplist = std::get<DnsHandler::IP_LIST>(row);
-
-                        for (auto ip : iplist)
-                        {
-                            SrvCache::records_t rec;
-                            // Server records
-                            // id|ip|server_name|cluster_id|cluster_name|subdomain
-
-                            if (sc.get_servers(rec, domain, ip) && rec.size())
-                            {
-                                for (const auto &s : rec)
-                                    ui.add_row({domain, ip, s[SrvCache::NAME], s[SrvCache::CLUSTER_NAME]});
-                            }
-                            else
-                                ui.add_row({domain, ip, "not found", "N/A"}, true);
-                        }
-                    }
+                    res.status = 404;
+                    return;
                 }
 
-                res.set_content(ui.render(), "text/html");
-            });
-    svr.Get("/servers", [&](const httplib::Request &, httplib::Response &res)
+                bool gzip = accepts_gzip(req.get_header_value("Accept-Encoding"));
+                auto etag = gzip ? gzip_etag(asset->etag) : std::string(asset->etag);
+                res.set_header("ETag", etag);
+                res.set_header("Cache-Control", "public, max-age=3600");
+                res.set_header("Vary", "Accept-Encoding");
+                if (etag_matches(req.get_header_value("If-None-Match"), etag))
+                {
+                    res.status = 304;
+                    return;
+                }
+
+                if (gzip)
+                {
+                    res.set_header("Content-Encoding", "gzip");
+                    res.set_content(reinterpret_cast<const char *>(asset->gzip),
+                                    asset->gzip_size, asset->mime);
+                }
+                else
+                    res.set_content(reinterpret_cast<const char *>(asset->data),
+                                    asset->size, asset->mime);
+            }));
+    // Rendered pages are reused until the zone or the inventory changes,
+    // concurrent requests for a page being built wait for that build
+    PageCache pages;
+    auto send_page = [](const httplib::Request &req,
+                        httplib::Response &res,
+                        const PageCache::page_ptr &page)
+    {
+        bool gzip = !page->gzip.empty() && accepts_gzip(req.get_header_value("Accept-Encoding"));
+        auto etag = gzip ? gzip_etag(page->etag) : page->etag;
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_header("Vary", "Accept-Encoding");
+        if (etag_matches(req.get_header_value("If-None-Match"), etag))
+        {
+            res.status = 304;
+            return;
+        }
+
+        if (gzip)
+        {
+            res.set_header("Content-Encoding", "gzip");
+            res.set_content(page->gzip, page->mime.c_str());
+        }
+        else
+            res.set_content(page->body, page->mime.c_str());
+    };
+
+    // Data saved by the previous run is served, marked, until revalidated
+    auto stale_notice = [&](httplib::Response &res) -> std::string
+    {
+        auto zone = dns.snapshot();
+        auto inventory = sc.inventory();
+        if (!(zone && zone->stale) && !(inventory && inventory->stale))
+            return "";
+        res.set_header("Warning", "110 dnskeeper \"Response is Stale\"");
+
+        char when[32] = "";
+        auto time = std::chrono::system_clock::to_time_t(saved.saved);
+        std::tm tm = {};
+        gmtime_r(&time, &tm);
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        return std::string("Showing the data saved at ") + when + " UTC while it is refreshed";
+    };
+
+    svr.Get("/dns", instrument("/dns", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                LOG(TRACE) << "Requested DNS Page\n";
+                PageCache::version_t version{dns.version(), sc.version()};
+                auto notice = stale_notice(res);
+                auto page = pages.get("dns", version, [&] {
+                    DnsUI ui;
+                    ui.notice(notice);
+
+                    // The listing comes from the zone snapshot at once. Only
+                    // before the first refresh does it go to Route53, while
+                    // the database is read
+                    auto listing = dns.list_records_async();
+                    SrvCache::records_t rec;
+                    sc.get_servers(rec);
+                    auto data = listing.get();
+                    if (data.ok)
+                        build_dns_page(ui, data.records, rec, domain_name);
+                    return ui.render();
+                });
+                send_page(req, res, page);
+            }));
+    svr.Get("/servers", instrument("/servers", [&](const httplib::Request &req, httplib::Response &res)
             {
-                const std::lock_guard<std::mutex> lock(render_mtx); // Avoid parallel page requests
-                ServerUI ui;
-                SrvCache::records_t rec;
-                DnsHandler::records_t data;
                 LOG(TRACE) << "Requested Servers Page\n";
+                PageCache::version_t version{dns.version(), sc.version()};
+                auto notice = stale_notice(res);
+                auto page = pages.get("servers", version, [&] {
+                    ServerUI ui;
+                    ui.notice(notice);
+                    auto listing = dns.list_records_async();
+                    SrvCache::records_t rec;
+                    sc.get_servers(rec);
+                    build_servers_page(ui, listing.get().records, rec, domain_name);
+                    return ui.render();
+                });
+                send_page(req, res, page);
+            }));
+    // JSON API (v1), streamed in chunks from the current snapshots
+    auto api_query = [](const httplib::Request &req)
+    {
+        api::query_t query;
+        query.cursor = req.get_param_value("cursor");
+        query.subdomain = req.get_param_value("subdomain");
+        query.cluster = req.get_param_value("cluster");
+        query.ip = req.get_param_value("ip");
+        long limit = query.limit;
+        if (req.has_param("limit"))
+            cast(req.get_param_value("limit"), limit);
+        query.limit = std::min(static_cast<size_t>(std::max(1L, limit)), api::max_limit);
+        return query;
+    };
+    auto api_unavailable = [](httplib::Response &res)
+    {
+        res.status = 503;
+        res.set_header("Retry-After", "5");
+        res.set_content("{\"error\":\"data not loaded yet\"}", "application/json");
+    };
 
-                // map of domains --> set of ips per domain
-                using dns_map = std::map<std::string, std::set<std::string>>;
-                dns_map domain_map;
-                if (dns.list_records(data))
-                {
-                    for (const auto &row : data)
+    svr.Get("/api/v1/records", instrument("/api/v1/records", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                LOG(TRACE) << "API call (records)\n";
+                auto zone = dns.snapshot();
+                if (!zone)
+                    return api_unavailable(res);
+                stale_notice(res);
+
+                auto inventory = sc.inventory();
+                auto query = api_query(req);
+                res.set_chunked_content_provider("application/json",
+                    [zone, inventory, query](size_t, httplib::DataSink &sink)
                     {
-                        auto domain = std::get<DnsHandler::DOMAIN>(row);
-                        auto &ipset = domain_map[domain]; // implicit create
+                        if (api::stream_records(zone, inventory, query, sink.write))
+                            sink.done();
+                        return true;
+                    });
+            }));
+    svr.Get("/api/v1/servers", instrument("/api/v1/servers", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                LOG(TRACE) << "API call (servers)\n";
+                auto inventory = sc.inventory();
+                if (!inventory)
+                    return api_unavailable(res);
+                stale_notice(res);
 
-                        auto iplist = std::get<DnsHandler::IP_LIST>(row);
-                        for (auto ip : iplist)
-                            ipset.insert(ip);
-                    }
-                }
-                if (sc.get_servers(rec) && rec.size())
-                {
-                    for (const auto &s : rec)
+                auto query = api_query(req);
+                res.set_chunked_content_provider("application/json",
+                    [inventory, query](size_t, httplib::DataSink &sink)
                     {
-                        // Server records
-                        // id|ip|server_name|cluster_id|cluster_name|subdomain
-                        auto subdomain = s[SrvCache::SUBDOMAIN];
-                        auto name = s[SrvCache::NAME];
-                        auto ip = s[SrvCache::IP_ADDR];
-                        auto domain = subdomain + "." + domain_name;
-                        auto it = domain_map.find(domain);
-                        if (it == domain_map.end())
-                        {
-                            ui.addition(name, domain, ip);
-                        }
-                        else
-                        {
-                            auto &ipset = it->second;
-                            if (ipset.find(ip) != ipset.end())
-                                ui.removal(name, domain, ip);
-                            else
-                                ui.addition(name, domain, ip);
-                        }
-                    }
+                        if (api::stream_servers(inventory, query, sink.write))
+                            sink.done();
+                        return true;
+                    });
+            }));
+    svr.Post("/api/v1/bulk", instrument("/api/v1/bulk", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                LOG(TRACE) << "API call (bulk)\n";
+                DnsHandler::mutations_t ops;
+                std::string error;
+                if (!api::parse_mutations(req.body, ops, error))
+                {
+                    res.status = 400;
+                    std::string body;
+                    JsonWriter(
+                        [&](const char *data, size_t len) { body.append(data, len); return true; })
+                        .begin_object().key("error").value(error).end_object();
+                    res.set_content(body, "application/json");
+                    return;
                 }
-                res.set_content(ui.render(), "text/html");
-            });
-    svr.Get("/add", [&](const httplib::Request &req, httplib::Response &res)
+
+                // Every affected RRset is read once and written in as
+                // few change batches as Route53 allows
+                dns.apply(ops);
+
+                std::string body;
+                api::write_results(ops, [&](const char *data, size_t len) {
+                    body.append(data, len);
+                    return true;
+                });
+                res.set_content(body, "application/json");
+            }));
+    svr.Get("/add", instrument("/add", [&](const httplib::Request &req, httplib::Response &res)
             {
                 std::string domain = req.get_param_value("domain");
                 std::string ip = req.get_param_value("ip");
+                std::string change_id;
                 LOG(TRACE) << "API call (add)\n";
 
-                if (dns.add_record(domain, ip))
-                    res.set_content("ADD_OK", "text/plain");
+                // Replies as soon as Route53 accepts the change. Progress
+                // is then available on /status using the change id
+                if (dns.add_record(domain, ip, change_id))
+                    res.set_content("ADD_OK " + change_id, "text/plain");
                 else
                     res.set_content("ADD_ERROR", "text/plain");
-            });
-    svr.Get("/remove", [&](const httplib::Request &req, httplib::Response &res)
+            }));
+    svr.Get("/remove", instrument("/remove", [&](const httplib::Request &req, httplib::Response &res)
             {
                 std::string domain = req.get_param_value("domain");
                 std::string ip = req.get_param_value("ip");
+                std::string change_id;
                 LOG(TRACE) << "API call (delete)\n";
 
-                if (dns.delete_record(domain, ip))
-                    res.set_content("DEL_OK", "text/plain");
+                if (dns.delete_record(domain, ip, change_id))
+                    res.set_content("DEL_OK " + change_id, "text/plain");
                 else
                     res.set_content("DEL_ERROR", "text/plain");
-                res.set_content("Operation in process", "text/plain");
+            }));
+    svr.Get("/status", instrument("/status", [&](const httplib::Request &req, httplib::Response &res)
+            {
+                std::string change_id = req.get_param_value("id");
+                LOG(TRACE) << "API call (status)\n";
+
+                auto status = dns.change_status(change_id);
+                res.set_content(ChangeTracker::to_string(status), "text/plain");
+            }));
+    svr.Get("/probes", [&](const httplib::Request &, httplib::Response &res)
+            {
+                std::string text;
+                if (prober)
+                    for (const auto &st : prober->status())
+                        text += st.name + " " + st.ip.to_string() + " "
+                                + Prober::to_string(st.state)
+                                + (st.pulled ? " PULLED\n" : "\n");
+                res.set_content(text, "text/plain");
+            });
+    svr.Get("/metrics", [&](const httplib::Request &, httplib::Response &res)
+            {
+                res.set_content(metrics::render(), "text/plain; version=0.0.4");
             });
 
+    // The zone and the inventory are saved for the next start once they
+    // are current, and again whenever either changes
+    std::mutex saver_mtx;
+    std::condition_variable saver_cv;
+    bool stopping = false;
+    std::thread saver;
+    if (!snapshot_path.empty())
+        saver = std::thread([&] {
+            PageCache::version_t written{0, 0};
+            std::unique_lock<std::mutex> lock(saver_mtx);
+            while (!saver_cv.wait_for(lock, std::chrono::seconds(std::max(1u, snapshot_interval)),
+                                      [&] { return stopping; }))
+            {
+                auto zone = dns.snapshot();
+                auto inventory = sc.inventory();
+                if (!zone || !inventory || zone->stale || inventory->stale)
+                    continue;
+                PageCache::version_t version{zone->version, inventory->version};
+                if (version != written && snapshot::save(snapshot_path, domain_name, *zone, *inventory))
+                    written = version;
+            }
+        });
+
     int port = std::stoi(argv[1]);
     LOG(INFO) << "Listening on port " << port << std::endl;
     svr.listen("0.0.0.0", port);
+
+    {
+        std::lock_guard<std::mutex> lock(saver_mtx);
+        stopping = true;
+    }
+    saver_cv.notify_all();
+    if (saver.joinable())
+        saver.join();
     return 0;
 }
\ No newline at end of file
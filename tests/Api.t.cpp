@@ -0,0 +1,138 @@
+#include <catch2/catch.hpp>
+#include <Api.hpp>
+#include <Fixtures.hpp>
+
+namespace {
+
+std::string collect(std::function<bool(JsonWriter::sink_t)> stream)
+{
+    std::string out;
+    REQUIRE(stream([&](const char *data, size_t len) {
+        out.append(data, len);
+        return true;
+    }));
+    return out;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Stream records with cursor pagination", "[Api]")
+{
+    auto zone = fixtures::zone();
+    auto inv = fixtures::inventory();
+    api::query_t query;
+    query.limit = 2;
+
+    auto page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page == R"({"version":7,"items":[)"
+                    R"({"name":"a.pyrotechnics.io","ttl":60,"type":"A","ips":["10.0.0.1","10.0.1.1"]},)"
+                    R"({"name":"b.pyrotechnics.io","ttl":60,"type":"A","ips":["10.0.0.1","10.0.1.2"]},)"
+                    R"({"name":"b.pyrotechnics.io","ttl":60,"type":"AAAA","ips":["fd00::b"]}],)"
+                    R"("next_cursor":"b.pyrotechnics.io"})");
+
+    query.cursor = "b.pyrotechnics.io";
+    page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page.find("b.pyrotechnics.io") == std::string::npos);
+    REQUIRE(page.find("c.pyrotechnics.io") != std::string::npos);
+    REQUIRE(page.find("\"next_cursor\":null") != std::string::npos);
+}
+
+TEST_CASE("Filter records by ip and cluster", "[Api]")
+{
+    auto zone = fixtures::zone();
+    auto inv = fixtures::inventory();
+    api::query_t query;
+    query.ip = "10.0.1.3";
+    auto page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page.find("a.pyrotechnics.io") == std::string::npos);
+    REQUIRE(page.find("c.pyrotechnics.io") != std::string::npos);
+
+    query.ip = "FD00:0::B";
+    page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page.find(R"("type":"AAAA","ips":["fd00::b"])") != std::string::npos);
+    REQUIRE(page.find(R"("type":"A")") == std::string::npos);
+
+    query.ip = "not-an-ip";
+    page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page.find("pyrotechnics.io") == std::string::npos);
+
+    query.ip = "";
+    query.cluster = "beta";
+    page = collect([&](auto sink) { return api::stream_records(zone, inv, query, sink); });
+    REQUIRE(page.find("a.pyrotechnics.io") == std::string::npos);
+    REQUIRE(page.find("b.pyrotechnics.io") != std::string::npos);
+}
+
+TEST_CASE("Stream servers with filters", "[Api]")
+{
+    auto inv = fixtures::inventory();
+    api::query_t query;
+    auto page = collect([&](auto sink) { return api::stream_servers(inv, query, sink); });
+    REQUIRE(page.find(R"({"id":1,"ip":"10.0.0.1","name":"srv\"1","cluster_id":5,"cluster":"alpha","subdomain":"a"})") != std::string::npos);
+
+    query.cluster = "beta";
+    query.limit = 1;
+    page = collect([&](auto sink) { return api::stream_servers(inv, query, sink); });
+    REQUIRE(page == R"({"version":3,"items":[{"id":2,"ip":"10.0.0.2","name":"srv2","cluster_id":6,"cluster":"beta","subdomain":"b"}],"next_cursor":"2"})");
+
+    query.cursor = "2";
+    page = collect([&](auto sink) { return api::stream_servers(inv, query, sink); });
+    REQUIRE(page.find("\"id\":4") != std::string::npos);
+    REQUIRE(page.find("\"next_cursor\":null") != std::string::npos);
+}
+
+TEST_CASE("Parse bulk operations", "[Api]")
+{
+    DnsHandler::mutations_t ops;
+    std::string error;
+    REQUIRE(api::parse_mutations(R"({"operations": [
+        {"domain": "a.pyrotechnics.io", "ip": "10.0.0.1", "action": "add"},
+        {"domain": "a.pyrotechnics.io", "ip": "10.0.0.2", "action": "remove"}]})", ops, error));
+    REQUIRE(ops.size() == 2);
+    REQUIRE(ops[0].name == "a.pyrotechnics.io");
+    REQUIRE(ops[0].action == DnsHandler::action_t::ADD);
+    REQUIRE(ops[1].ip == "10.0.0.2");
+    REQUIRE(ops[1].action == DnsHandler::action_t::REMOVE);
+
+    ops.clear();
+    REQUIRE(api::parse_mutations(R"([{"domain":"b","ip":"1","action":"add"}])", ops, error));
+    REQUIRE(ops.size() == 1);
+
+    REQUIRE(!api::parse_mutations(R"([{"domain":"b","ip":"1","action":"flip"}])", ops, error));
+    REQUIRE(!api::parse_mutations(R"([{"domain":"b","action":"add"}])", ops, error));
+    REQUIRE(!api::parse_mutations(R"({"operations": [)", ops, error));
+    REQUIRE(error == "malformed JSON");
+}
+
+TEST_CASE("Read JSON values and reject malformed input", "[Api]")
+{
+    JsonValue doc;
+    REQUIRE(JsonReader(R"({"a": true, "b": false, "c": [0, -1.5, 2e10, 3E-2, null]})").parse(doc));
+    REQUIRE(doc.find("a")->boolean == true);
+    REQUIRE(doc.find("b")->type == JsonValue::BOOLEAN);
+    REQUIRE(doc.find("b")->boolean == false);
+    const auto &numbers = doc.find("c")->items;
+    REQUIRE(numbers.size() == 5);
+    REQUIRE(numbers[1].type == JsonValue::NUMBER);
+    REQUIRE(numbers[1].text == "-1.5");
+    REQUIRE(numbers[3].text == "3E-2");
+
+    for (auto text : {"1-2", "--1", "-", "+1", "01", "1.", ".5", "1e", "1e+", "[1-2]",
+                      "[1,]", "truefalse", "tru", "nul", "{\"a\" 1}", "[\"\\x\"]", ""})
+    {
+        INFO(text);
+        JsonValue value;
+        REQUIRE(!JsonReader(text).parse(value));
+    }
+}
+
+TEST_CASE("Report per operation results", "[Api]")
+{
+    DnsHandler::mutations_t ops(2);
+    ops[0] = {"a.pyrotechnics.io", "10.0.0.1", DnsHandler::action_t::ADD, true, "C1"};
+    ops[1] = {"a.pyrotechnics.io", "10.0.0.9", DnsHandler::action_t::REMOVE, false, "", "address not published"};
+    auto out = collect([&](auto sink) { return api::write_results(ops, sink); });
+    REQUIRE(out == R"({"ok":false,"results":[)"
+                   R"({"domain":"a.pyrotechnics.io","ip":"10.0.0.1","action":"add","ok":true,"change_id":"C1"},)"
+                   R"({"domain":"a.pyrotechnics.io","ip":"10.0.0.9","action":"remove","ok":false,"change_id":"","error":"address not published"}]})");
+}
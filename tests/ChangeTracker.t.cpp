@@ -0,0 +1,36 @@
+#include <catch2/catch.hpp>
+#include <ChangeTracker.hpp>
+
+#include <atomic>
+
+TEST_CASE("Changes are polled until synchronized", "[ChangeTracker]")
+{
+    std::atomic<int> polls{0};
+    ChangeTracker tracker([&](const std::string &, bool &insync) {
+        insync = (++polls >= 2);
+        return true;
+    });
+
+    std::atomic<bool> notified{false};
+    auto id = tracker.track("/change/C1234", [&](const std::string &, ChangeTracker::status_t st) {
+        notified = (st == ChangeTracker::status_t::INSYNC);
+    });
+    REQUIRE(id == "C1234");
+    REQUIRE(tracker.status(id) == ChangeTracker::status_t::PENDING);
+    REQUIRE(tracker.wait(id, 10s) == ChangeTracker::status_t::INSYNC);
+    REQUIRE(tracker.pending() == 0);
+    REQUIRE(polls == 2);
+    REQUIRE(notified == true);
+}
+
+TEST_CASE("Changes fail after the timeout", "[ChangeTracker]")
+{
+    ChangeTracker tracker([](const std::string &, bool &insync) {
+        insync = false;
+        return false;
+    }, 1s);
+
+    auto id = tracker.track("C5678");
+    REQUIRE(tracker.wait(id, 10s) == ChangeTracker::status_t::FAILED);
+    REQUIRE(tracker.status("unknown") == ChangeTracker::status_t::UNKNOWN);
+}
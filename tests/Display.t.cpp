@@ -0,0 +1,89 @@
+#include <catch2/catch.hpp>
+#include <Display.hpp>
+
+TEST_CASE("Render a table page from the embedded template", "[Display]")
+{
+    DnsUI ui;
+    ui.add_row({"a.pyrotechnics.io", "10.0.0.1", "tsrv1", "cluster1"});
+    ui.add_row({"b.pyrotechnics.io", "10.0.0.2", "not found", "N/A"}, true);
+    auto page = ui.render();
+
+    REQUIRE(page.find("DNS Records") != std::string::npos);
+    REQUIRE(page.find("<th>Domain String</th>") != std::string::npos);
+    REQUIRE(page.find("<!-- TITLE -->") == std::string::npos);
+
+    // Rows keep their order and land inside the table body
+    auto first = page.find("<td>a.pyrotechnics.io</td>");
+    auto second = page.find("<tr class=\"flagged\"><td>b.pyrotechnics.io</td>");
+    REQUIRE(first != std::string::npos);
+    REQUIRE(second > first);
+    REQUIRE(page.find("</tbody>") > second);
+    REQUIRE(page.rfind("<tbody>", first) != std::string::npos);
+
+    ui.clear();
+    REQUIRE(ui.render().find("pyrotechnics") == std::string::npos);
+
+    // The notice sits between the subtitle and the table
+    ui.notice("Saved data");
+    page = ui.render();
+    auto notice = page.find("<p class=\"notice\">Saved data</p>");
+    REQUIRE(notice != std::string::npos);
+    REQUIRE(notice > page.find("</H4>"));
+    REQUIRE(notice < page.find("<table"));
+    ui.notice("");
+    REQUIRE(ui.render().find("Saved data") == std::string::npos);
+}
+
+TEST_CASE("Suspect server input is not rendered", "[Display]")
+{
+    ServerUI ui;
+    ui.addition("tsrv1", "test1.pyrotechnics.io", "10.0.0.1");
+    ui.removal("tsrv2", "test1.pyrotechnics.io", "10.0.0.2");
+    ui.addition("<b>bad</b>", "test1.pyrotechnics.io", "10.0.0.3");
+    ui.addition("tsrv3", "test1.pyrotechnics.io", "fd00::3");
+    ui.addition("tsrv4", "test1.pyrotechnics.io", "9999.1");
+    auto page = ui.render();
+
+    REQUIRE(page.find("/add?name=tsrv1&domain=test1.pyrotechnics.io&ip=10.0.0.1") != std::string::npos);
+    REQUIRE(page.find("/remove?name=tsrv2") != std::string::npos);
+    REQUIRE(page.find("<b>bad") == std::string::npos);
+    REQUIRE(page.find("ip=fd00::3") != std::string::npos);
+    REQUIRE(page.find("tsrv4") == std::string::npos);
+}
+
+TEST_CASE("Static assets are embedded", "[Assets]")
+{
+    const asset_t *index = find_asset("index.html");
+    REQUIRE(index != nullptr);
+    REQUIRE(std::string(index->mime) == "text/html");
+    REQUIRE(index->view().find("DNS Keeper") != std::string::npos);
+    REQUIRE(index->gzip_size > 0);
+    REQUIRE(etag_matches(index->etag, index->etag));
+    REQUIRE(etag_matches(std::string("W/") + index->etag, index->etag));
+    REQUIRE(!etag_matches("\"other\"", index->etag));
+    REQUIRE(find_asset("missing.html") == nullptr);
+}
+
+TEST_CASE("Gzip follows Accept-Encoding q-values", "[Assets]")
+{
+    REQUIRE(accepts_gzip("gzip"));
+    REQUIRE(accepts_gzip("deflate, gzip;q=0.5, br"));
+    REQUIRE(accepts_gzip("GZIP"));
+    REQUIRE(accepts_gzip("*"));
+    REQUIRE(accepts_gzip("x-gzip"));
+    REQUIRE(!accepts_gzip(""));
+    REQUIRE(!accepts_gzip("identity"));
+    REQUIRE(!accepts_gzip("gzip;q=0"));
+    REQUIRE(!accepts_gzip("gzip; q=0.000, deflate"));
+    REQUIRE(!accepts_gzip("*;q=1, gzip;q=0"));
+    REQUIRE(!accepts_gzip("*;q=0"));
+
+    // The gzip body has its own tag, neither matches the other
+    const asset_t *index = find_asset("index.html");
+    auto gz = gzip_etag(index->etag);
+    REQUIRE(gz.back() == '"');
+    REQUIRE(gz != index->etag);
+    REQUIRE(!etag_matches(gz, index->etag));
+    REQUIRE(!etag_matches(index->etag, gz));
+    REQUIRE(etag_matches(gz, gz));
+}
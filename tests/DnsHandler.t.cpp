@@ -1,5 +1,9 @@
 #include <catch2/catch.hpp>
 #include <DnsHandler.hpp>
+#include <Route53Emulator.hpp>
+#include <Fixtures.hpp>
+
+#include <unistd.h>
 
 TEST_CASE("Confirm Hosted Zone setup", "[HostedZone]")
 {
@@ -65,3 +69,464 @@ TEST_CASE("Delete record on subdomain", "[Records]")
     ip = "10.9.8.6";
     REQUIRE(dns.delete_record(name, ip) == true);
 }
+
+TEST_CASE("Track change until synchronized", "[Changes]")
+{
+    REQUIRE(configured_properly());
+    std::string domain = "";
+    CHECK(secure_config("DOMAIN_NAME", domain));
+    DnsHandler dns(domain);
+    std::string name = "unittest.pyrotechnics.io";
+    std::string change_id;
+    REQUIRE(dns.add_record(name, "10.9.8.7", change_id) == true);
+    REQUIRE(change_id != "");
+    REQUIRE(dns.change_status(change_id) == ChangeTracker::status_t::PENDING);
+    REQUIRE(dns.await_change(change_id) == ChangeTracker::status_t::INSYNC);
+    REQUIRE(dns.delete_record(name, "10.9.8.7", change_id) == true);
+    REQUIRE(dns.await_change(change_id) == ChangeTracker::status_t::INSYNC);
+}
+
+namespace {
+
+// The emulator needs no protection from bursts
+void unlimited()
+{
+    RateLimiter::options_t options;
+    options.read_rate = 0;
+    options.change_rate = 0;
+    RateLimiter::process().configure(options);
+}
+
+// Publishes an RRset straight into the emulator
+void publish(Route53Emulator &r53, const std::string &name, Model::RRType type,
+             const std::vector<std::string> &ips)
+{
+    auto rrs = Model::ResourceRecordSet().WithName(name).WithType(type).WithTTL(60);
+    for (const auto &ip : ips)
+        rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip));
+    REQUIRE(r53.ChangeResourceRecordSets(
+        Model::ChangeResourceRecordSetsRequest()
+            .WithHostedZoneId(Route53Emulator::zone_id)
+            .WithChangeBatch(Model::ChangeBatch().AddChanges(
+                Model::Change().WithAction(Model::ChangeAction::CREATE).WithResourceRecordSet(rrs))))
+                .IsSuccess());
+}
+
+size_t published(DnsHandler &dns, const std::string &name,
+                 Model::RRType type = Model::RRType::A)
+{
+    DnsHandler::rrset_t rrs;
+    if (!dns.get_record(name, rrs, true, type))
+        return 0;
+    return rrs.GetResourceRecords().size();
+}
+
+// The emulator, except that zone discovery fails while down is set
+class OutageProvider : public DnsProvider
+{
+public:
+    std::shared_ptr<Route53Emulator> r53;
+    std::atomic<bool> down{true};
+    std::atomic<int> discoveries{0};
+
+    explicit OutageProvider(std::shared_ptr<Route53Emulator> r53) : r53(r53) {}
+
+    Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &request) override
+    {
+        discoveries++;
+        if (down)
+            return Aws::Client::AWSError<Route53Errors>(Route53Errors::INVALID_INPUT, "Error", "Injected", false);
+        return r53->ListHostedZonesByName(request);
+    }
+    Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &request) override
+    {
+        return r53->ListResourceRecordSets(request);
+    }
+    Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &request) override
+    {
+        return r53->ChangeResourceRecordSets(request);
+    }
+    Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &request) override
+    {
+        return r53->GetChange(request);
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Hosted zones are merged and writes routed by suffix", "[Zones]")
+{
+    unlimited();
+    Route53Emulator::options_t options{"example.com"};
+    options.private_zones = {"ca.example.com"};
+    auto r53 = std::make_shared<Route53Emulator>(options);
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53);
+    REQUIRE(dns.get_hosted_zone() == Route53Emulator::zone_id);
+    REQUIRE(dns.hosted_zones().size() == 2);
+    REQUIRE(dns.zone_for("a.ca.example.com")->private_zone == true);
+    REQUIRE(dns.zone_for("a.xca.example.com")->id == Route53Emulator::zone_id);
+    REQUIRE(dns.zone_for("example.org") == nullptr);
+
+    // The emulator rejects names outside the zone they are written to
+    REQUIRE(dns.add_record("a.ca.example.com", "10.0.0.1") == true);
+    REQUIRE(dns.add_record("a.example.com", "10.0.0.2") == true);
+    REQUIRE(dns.add_record("a.example.org", "10.0.0.3") == false);
+    REQUIRE(r53->size() == 2);
+
+    DnsHandler::records_t data;
+    REQUIRE(dns.list_records(data, true) == true);
+    REQUIRE(data.size() == 2);
+    REQUIRE(std::get<DnsHandler::DOMAIN>(data[0]) == "a.ca.example.com");
+}
+
+TEST_CASE("Zone discovery is retried after a failure", "[Zones]")
+{
+    unlimited();
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    publish(*r53, "a.example.com", Model::RRType::A, {"10.0.0.1"});
+    auto provider = std::make_shared<OutageProvider>(r53);
+    DnsHandler dns("example.com", 1s, 10ms, 0, provider);
+    REQUIRE(dns.get_hosted_zone() == "");
+    REQUIRE(dns.snapshot() == nullptr);
+    REQUIRE(dns.add_record("b.example.com", "10.0.0.2") == false);
+
+    // Writes and the refresher both find the zones once Route53 answers
+    provider->down = false;
+    REQUIRE(dns.add_record("b.example.com", "10.0.0.2") == true);
+    for (int i = 0; i < 300 && !dns.snapshot(); i++)
+        std::this_thread::sleep_for(10ms);
+    REQUIRE(dns.snapshot() != nullptr);
+    DnsHandler::rrset_t rrs;
+    REQUIRE(dns.get_record("a.example.com", rrs) == true);
+}
+
+TEST_CASE("Zones are listed past the first page and by subtree", "[Zones]")
+{
+    unlimited();
+    Route53Emulator::options_t options{"example.com"};
+    options.private_zones = {"ca.example.com"};
+    options.max_items = 10;
+    auto r53 = std::make_shared<Route53Emulator>(options);
+
+    auto populate = [&](const std::string &zone_id, const std::string &suffix, int count) {
+        auto batch = Model::ChangeBatch();
+        for (int i = 0; i < count; i++)
+            batch.AddChanges(Model::Change()
+                                 .WithAction(Model::ChangeAction::CREATE)
+                                 .WithResourceRecordSet(Model::ResourceRecordSet()
+                                                            .WithName("h" + std::to_string(i) + suffix)
+                                                            .WithType(Model::RRType::A)
+                                                            .WithTTL(60)
+                                                            .AddResourceRecords(Model::ResourceRecord().WithValue("10.0.0.1"))));
+        REQUIRE(r53->ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()
+                                                  .WithHostedZoneId(zone_id)
+                                                  .WithChangeBatch(batch)).IsSuccess());
+    };
+    populate(Route53Emulator::zone_id, ".example.com", 25);
+    populate(Route53Emulator::zone_id, ".us.example.com", 5);
+    populate(Route53Emulator::zone_id, ".us-east.example.com", 3);
+    populate("Z1EMULATED", ".ca.example.com", 12);
+
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53);
+    DnsHandler::records_t data;
+    REQUIRE(dns.list_records(data) == true);
+    REQUIRE(data.size() == 45);
+
+    data.clear();
+    REQUIRE(dns.list_subtree(data, "us.example.com") == true);
+    REQUIRE(data.size() == 5);
+
+    data.clear();
+    REQUIRE(dns.list_subtree(data, "ca.example.com") == true);
+    REQUIRE(data.size() == 12);
+
+    data.clear();
+    REQUIRE(dns.list_subtree(data, "example.com") == true);
+    REQUIRE(data.size() == 45);
+
+    data.clear();
+    REQUIRE(dns.list_subtree(data, "h3.example.com", Model::RRType::AAAA) == true);
+    REQUIRE(data.empty());
+}
+
+TEST_CASE("A refresh keeps local writes made while it listed", "[Zones]")
+{
+    unlimited();
+    Route53Emulator::options_t options{"example.com"};
+    options.latency = 100ms;
+    options.max_items = 2;
+    auto r53 = std::make_shared<Route53Emulator>(options);
+    for (auto name : {"b", "c", "d", "e", "f", "g", "h"})
+        publish(*r53, std::string(name) + ".example.com", Model::RRType::A, {"10.0.0.1"});
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53);
+
+    // Made behind the handler's back, only a refresh finds it
+    publish(*r53, "z.example.com", Model::RRType::A, {"10.0.0.1"});
+
+    // The listing reads the first page (where a.example.com sorts)
+    // before the write reaches Route53, and ends after it is published
+    bool refreshed = false;
+    std::thread refresher([&] { refreshed = dns.refresh(); });
+    std::this_thread::sleep_for(150ms);
+    REQUIRE(dns.add_record("a.example.com", "10.0.0.2") == true);
+    refresher.join();
+    REQUIRE(refreshed == true);
+
+    DnsHandler::rrset_t rrs;
+    REQUIRE(dns.get_record("z.example.com", rrs) == true);
+    REQUIRE(dns.get_record("a.example.com", rrs) == true);
+    REQUIRE(dns.snapshot()->records.size() == 9);
+}
+
+TEST_CASE("Changes journaled before a restart are resumed", "[Zones]")
+{
+    unlimited();
+    auto path = fixtures::scratch("journal");
+    {
+        // Stopped after the first add reached Route53
+        std::ofstream out(path);
+        out << "O 7 0 2 A a.example.com 10.0.0.1\n"
+            << "O 7 1 2 A b.example.com 10.0.0.2\n"
+            << "C 7 C1 0\n";
+    }
+
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53);
+    auto journal = std::make_shared<Journal>(path);
+    REQUIRE(dns.resume(journal) == 1);
+
+    // Only the operation that was never submitted is replayed
+    REQUIRE(r53->size() == 1);
+    DnsHandler::rrset_t rrs;
+    REQUIRE(dns.get_record("b.example.com", rrs, true) == true);
+
+    // Later changes are journaled until INSYNC
+    std::string change_id;
+    REQUIRE(dns.add_record("c.example.com", "10.0.0.3", change_id) == true);
+    REQUIRE(dns.await_change(change_id, 10s) == ChangeTracker::status_t::INSYNC);
+    unlink(path.c_str());
+}
+
+TEST_CASE("Queued writes are applied and journaled on destruction", "[Zones]")
+{
+    unlimited();
+    auto path = fixtures::scratch("shutdown");
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    std::vector<std::future<DnsHandler::mutation_t>> writes;
+    {
+        // The window is still open when the handler goes
+        DnsHandler dns("example.com", 30s, 10s, 0, r53);
+        auto journal = std::make_shared<Journal>(path);
+        REQUIRE(dns.resume(journal) == 0);
+        for (auto name : {"a.example.com", "b.example.com", "c.example.com"})
+            writes.push_back(dns.add_record_async(name, "10.0.0.1"));
+    }
+    for (auto &write : writes)
+        REQUIRE(write.get().ok == true);
+    REQUIRE(r53->size() == 3);
+
+    // Submitted and applied, only the INSYNC poll may be left over
+    Journal journal(path);
+    for (const auto &entry : journal.recover())
+    {
+        REQUIRE(entry.applied == true);
+        REQUIRE(entry.changes.size() <= 1);
+    }
+    unlink(path.c_str());
+}
+
+TEST_CASE("A seeded zone is served until revalidated", "[Zones]")
+{
+    unlimited();
+    // Slow enough that the revalidation cannot win the race below
+    Route53Emulator::options_t options{"example.com"};
+    options.latency = 200ms;
+    auto r53 = std::make_shared<Route53Emulator>(options);
+    REQUIRE(r53->ChangeResourceRecordSets(
+        Model::ChangeResourceRecordSetsRequest()
+            .WithHostedZoneId(Route53Emulator::zone_id)
+            .WithChangeBatch(Model::ChangeBatch().AddChanges(
+                Model::Change()
+                    .WithAction(Model::ChangeAction::CREATE)
+                    .WithResourceRecordSet(Model::ResourceRecordSet()
+                                               .WithName("live.example.com")
+                                               .WithType(Model::RRType::A)
+                                               .WithTTL(60)
+                                               .AddResourceRecords(Model::ResourceRecord().WithValue("10.0.0.9"))))))
+                .IsSuccess());
+
+    IpAddr ip;
+    IpAddr::parse("10.0.0.1", ip);
+    auto seed = std::make_shared<DnsHandler::zone_t>();
+    DnsHandler::load_records(*seed, {{"saved.example.com", {ip}, 60, static_cast<char>(Model::RRType::A)}});
+
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53, seed);
+    auto zone = dns.snapshot();
+    DnsHandler::rrset_t rrs;
+    REQUIRE(zone->stale);
+    REQUIRE(dns.get_record("saved.example.com", rrs) == true);
+
+    for (int i = 0; i < 300 && dns.snapshot()->stale; i++)
+        std::this_thread::sleep_for(10ms);
+    zone = dns.snapshot();
+    REQUIRE(zone->stale == false);
+    REQUIRE(zone->version > 1);
+    REQUIRE(dns.get_record("saved.example.com", rrs) == false);
+    REQUIRE(dns.get_record("live.example.com", rrs) == true);
+}
+
+TEST_CASE("A seeded handler discovers its zones in the background", "[Zones]")
+{
+    unlimited();
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    publish(*r53, "live.example.com", Model::RRType::A, {"10.0.0.9"});
+    auto provider = std::make_shared<OutageProvider>(r53);
+
+    IpAddr ip;
+    IpAddr::parse("10.0.0.1", ip);
+    auto seed = std::make_shared<DnsHandler::zone_t>();
+    DnsHandler::load_records(*seed, {{"saved.example.com", {ip}, 60, static_cast<char>(Model::RRType::A)}});
+
+    // Route53 is unreachable at startup: the seed is served, and the
+    // refresher keeps trying
+    DnsHandler dns("example.com", 1s, 10ms, 0, provider, seed);
+    DnsHandler::rrset_t rrs;
+    REQUIRE(dns.snapshot()->stale);
+    REQUIRE(dns.get_record("saved.example.com", rrs) == true);
+    for (int i = 0; i < 300 && provider->discoveries < 2; i++)
+        std::this_thread::sleep_for(10ms);
+    REQUIRE(provider->discoveries >= 2);
+    REQUIRE(dns.snapshot()->stale);
+
+    provider->down = false;
+    for (int i = 0; i < 300 && dns.snapshot()->stale; i++)
+        std::this_thread::sleep_for(10ms);
+    REQUIRE(dns.snapshot()->stale == false);
+    REQUIRE(dns.get_record("live.example.com", rrs) == true);
+}
+
+TEST_CASE("Asynchronous calls overlap", "[Zones]")
+{
+    unlimited();
+    Route53Emulator::options_t options{"example.com"};
+    options.latency = 200ms;
+    auto r53 = std::make_shared<Route53Emulator>(options);
+    DnsHandler dns("example.com", 30s, 10ms, 0, r53);
+
+    auto added = dns.add_record_async("a.example.com", "10.0.0.1");
+    auto op = added.get();
+    REQUIRE(op.ok == true);
+    REQUIRE(!op.change_id.empty());
+
+    // Snapshot reads are answered at once
+    auto cached = dns.get_record_async("a.example.com");
+    REQUIRE(cached.wait_for(0s) == std::future_status::ready);
+    REQUIRE(cached.get().ok == true);
+
+    // Two live reads wait on Route53 side by side. Nothing else is
+    // running once the change is in sync
+    REQUIRE(dns.await_change(op.change_id, 10s) == ChangeTracker::status_t::INSYNC);
+    r53->max_in_flight();
+    auto listing = dns.list_records_async(true);
+    auto lookup = dns.get_record_async("a.example.com", true);
+    REQUIRE(listing.get().records.size() == 1);
+    REQUIRE(lookup.get().rrset.GetResourceRecords().size() == 1);
+    REQUIRE(r53->max_in_flight() == 2);
+
+    auto removed = dns.delete_record_async("a.example.com", "10.0.0.1").get();
+    REQUIRE(removed.ok == true);
+    REQUIRE(r53->size() == 0);
+}
+
+TEST_CASE("Writes in one window share a change", "[Zones]")
+{
+    unlimited();
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    DnsHandler dns("example.com", 30s, 200ms, 0, r53);
+
+    std::vector<std::future<DnsHandler::mutation_t>> writes;
+    writes.push_back(dns.add_record_async("a.example.com", "10.0.0.1"));
+    writes.push_back(dns.add_record_async("a.example.com", "10.0.0.2"));
+    writes.push_back(dns.add_record_async("b.example.com", "10.0.0.3"));
+    writes.push_back(dns.add_record_async("c.example.com", "fd00::c"));
+    std::vector<DnsHandler::mutation_t> ops;
+    for (auto &write : writes)
+        ops.push_back(write.get());
+
+    REQUIRE(r53->change_calls() == 1);
+    for (const auto &op : ops)
+    {
+        REQUIRE(op.ok == true);
+        REQUIRE(op.change_id == ops[0].change_id);
+    }
+    REQUIRE(!ops[0].change_id.empty());
+    REQUIRE(published(dns, "a.example.com") == 2);
+    REQUIRE(published(dns, "b.example.com") == 1);
+    REQUIRE(published(dns, "c.example.com", Model::RRType::AAAA) == 1);
+}
+
+TEST_CASE("An add and a remove of the same address cancel out", "[Zones]")
+{
+    unlimited();
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+    publish(*r53, "a.example.com", Model::RRType::A, {"10.0.0.1"});
+    DnsHandler dns("example.com", 30s, 200ms, 0, r53);
+    auto before = r53->change_calls();
+
+    auto added = dns.add_record_async("b.example.com", "10.0.0.2");
+    auto removed = dns.delete_record_async("b.example.com", "10.0.0.2");
+    auto removed_again = dns.delete_record_async("a.example.com", "10.0.0.1");
+    auto readded = dns.add_record_async("a.example.com", "10.0.0.1");
+    REQUIRE(added.get().ok == true);
+    REQUIRE(removed.get().ok == true);
+    REQUIRE(removed_again.get().ok == true);
+    REQUIRE(readded.get().ok == true);
+
+    REQUIRE(r53->change_calls() == before);
+    REQUIRE(published(dns, "a.example.com") == 1);
+    REQUIRE(published(dns, "b.example.com") == 0);
+}
+
+TEST_CASE("Batches are split at the Route53 limits", "[Zones]")
+{
+    unlimited();
+    auto r53 = std::make_shared<Route53Emulator>(Route53Emulator::options_t{"example.com"});
+
+    // 2 x 301 values, counted twice by UPSERT: over 1000 records
+    std::vector<std::string> v4;
+    for (int i = 0; i < 300; i++)
+        v4.push_back("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+    publish(*r53, "big1.example.com", Model::RRType::A, v4);
+    publish(*r53, "big2.example.com", Model::RRType::A, v4);
+
+    // 2 x 221 values of 39 characters, counted twice: over 32000
+    // characters with only 884 records
+    std::vector<std::string> v6;
+    for (int i = 0; i < 220; i++)
+        v6.push_back("fd00:1111:2222:3333:4444:5555:6666:" + std::to_string(1000 + i));
+    publish(*r53, "long1.example.com", Model::RRType::AAAA, v6);
+    publish(*r53, "long2.example.com", Model::RRType::AAAA, v6);
+
+    DnsHandler dns("example.com", 30s, 200ms, 0, r53);
+    auto before = r53->change_calls();
+    auto big1 = dns.add_record_async("big1.example.com", "10.1.0.1");
+    auto big2 = dns.add_record_async("big2.example.com", "10.1.0.2");
+    REQUIRE(big1.get().ok == true);
+    REQUIRE(big2.get().ok == true);
+    REQUIRE(r53->change_calls() == before + 2);
+    REQUIRE(published(dns, "big1.example.com") == 301);
+    REQUIRE(published(dns, "big2.example.com") == 301);
+
+    before = r53->change_calls();
+    auto long1 = dns.add_record_async("long1.example.com", "fd00:1111:2222:3333:4444:5555:6666:2001");
+    auto long2 = dns.add_record_async("long2.example.com", "fd00:1111:2222:3333:4444:5555:6666:2002");
+    REQUIRE(long1.get().ok == true);
+    REQUIRE(long2.get().ok == true);
+    REQUIRE(r53->change_calls() == before + 2);
+    REQUIRE(published(dns, "long1.example.com", Model::RRType::AAAA) == 221);
+    REQUIRE(published(dns, "long2.example.com", Model::RRType::AAAA) == 221);
+}
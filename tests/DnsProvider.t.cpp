@@ -0,0 +1,90 @@
+#include <catch2/catch.hpp>
+#include <DnsProvider.hpp>
+
+namespace {
+
+// Fails the first `failures` calls with the given error
+class FlakyProvider : public DnsProvider
+{
+public:
+    Route53Errors error;
+    int failures;
+    int calls = 0;
+
+    FlakyProvider(Route53Errors error, int failures) : error(error), failures(failures) {}
+
+    template <typename Outcome>
+    Outcome next()
+    {
+        if (calls++ < failures)
+            return Aws::Client::AWSError<Route53Errors>(error, "Error", "Injected", false);
+        return typename std::decay_t<decltype(Outcome().GetResult())>();
+    }
+
+    Model::ListHostedZonesByNameOutcome
+    ListHostedZonesByName(const Model::ListHostedZonesByNameRequest &) override
+    {
+        return next<Model::ListHostedZonesByNameOutcome>();
+    }
+    Model::ListResourceRecordSetsOutcome
+    ListResourceRecordSets(const Model::ListResourceRecordSetsRequest &) override
+    {
+        return next<Model::ListResourceRecordSetsOutcome>();
+    }
+    Model::ChangeResourceRecordSetsOutcome
+    ChangeResourceRecordSets(const Model::ChangeResourceRecordSetsRequest &) override
+    {
+        return next<Model::ChangeResourceRecordSetsOutcome>();
+    }
+    Model::GetChangeOutcome
+    GetChange(const Model::GetChangeRequest &) override
+    {
+        return next<Model::GetChangeOutcome>();
+    }
+};
+
+RateLimiter::options_t fast()
+{
+    RateLimiter::options_t options;
+    options.read_rate = 0;
+    options.change_rate = 0;
+    options.max_attempts = 4;
+    options.base_delay = 1ms;
+    options.max_delay = 5ms;
+    return options;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Throttled calls are retried", "[LimitedProvider]")
+{
+    RateLimiter limiter(fast());
+    auto flaky = std::make_shared<FlakyProvider>(Route53Errors::THROTTLING, 3);
+    LimitedProvider provider(flaky, limiter);
+    REQUIRE(provider.ListResourceRecordSets(Model::ListResourceRecordSetsRequest()).IsSuccess());
+    REQUIRE(flaky->calls == 4);
+
+    // Gives up after max_attempts
+    flaky->calls = 0;
+    flaky->failures = 10;
+    REQUIRE(!provider.GetChange(Model::GetChangeRequest()).IsSuccess());
+    REQUIRE(flaky->calls == 4);
+}
+
+TEST_CASE("Only retryable errors are retried", "[LimitedProvider]")
+{
+    RateLimiter limiter(fast());
+    auto flaky = std::make_shared<FlakyProvider>(Route53Errors::INVALID_CHANGE_BATCH, 1);
+    LimitedProvider provider(flaky, limiter);
+    REQUIRE(!provider.ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()).IsSuccess());
+    REQUIRE(flaky->calls == 1);
+
+    // A change that may have been applied is not repeated, a read is
+    flaky->calls = 0;
+    flaky->error = Route53Errors::NETWORK_CONNECTION;
+    REQUIRE(!provider.ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()).IsSuccess());
+    REQUIRE(flaky->calls == 1);
+    flaky->calls = 0;
+    REQUIRE(provider.ListResourceRecordSets(Model::ListResourceRecordSetsRequest()).IsSuccess());
+    REQUIRE(flaky->calls == 2);
+}
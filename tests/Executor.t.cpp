@@ -0,0 +1,53 @@
+#include <catch2/catch.hpp>
+#include <Executor.hpp>
+
+TEST_CASE("Tasks run on the workers and deliver results", "[Executor]")
+{
+    Executor executor(2);
+    auto main_thread = std::this_thread::get_id();
+    auto answer = executor.submit([] { return 42; });
+    auto where = executor.submit([] { return std::this_thread::get_id(); });
+    REQUIRE(answer.get() == 42);
+    REQUIRE(where.get() != main_thread);
+
+    auto failing = executor.submit([]() -> int { throw std::runtime_error("failed"); });
+    REQUIRE_THROWS_AS(failing.get(), std::runtime_error);
+
+    // Workers survive anything a posted task throws
+    executor.post([] { throw 7; });
+    executor.post([] { throw 8; });
+    REQUIRE(executor.submit([] { return 43; }).get() == 43);
+}
+
+TEST_CASE("Workers run tasks concurrently", "[Executor]")
+{
+    // Each task waits until all four are running
+    Executor executor(4);
+    std::mutex mtx;
+    std::condition_variable cv;
+    int running = 0;
+    std::vector<std::future<bool>> tasks;
+    for (int i = 0; i < 4; i++)
+        tasks.push_back(executor.submit([&] {
+            std::unique_lock<std::mutex> lock(mtx);
+            running++;
+            cv.notify_all();
+            return cv.wait_for(lock, 10s, [&] { return running == 4; });
+        }));
+    for (auto &task : tasks)
+        REQUIRE(task.get() == true);
+}
+
+TEST_CASE("Queued tasks finish before destruction", "[Executor]")
+{
+    std::atomic<int> done{0};
+    {
+        Executor executor(1);
+        for (int i = 0; i < 10; i++)
+            executor.post([&] {
+                std::this_thread::sleep_for(5ms);
+                done++;
+            });
+    }
+    REQUIRE(done == 10);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <DnsHandler.hpp>
+#include <SrvCache.hpp>
+
+#include <unistd.h>
+
+// Data and files shared by the test cases
+namespace fixtures {
+
+// A path under /tmp unique to the test process, removed if left over
+inline std::string scratch(const std::string &name)
+{
+    auto path = "/tmp/dnskeeper.t." + std::to_string(getpid()) + "." + name;
+    unlink(path.c_str());
+    return path;
+}
+
+// a, b and c.pyrotechnics.io with two A values each (10.0.0.1 and
+// 10.0.1.<n>), and an AAAA record on b
+inline DnsHandler::snapshot_t zone(uint64_t version = 7)
+{
+    Aws::Vector<DnsHandler::rrset_t> rrsets;
+    for (auto name : {"a.pyrotechnics.io", "b.pyrotechnics.io", "c.pyrotechnics.io"})
+    {
+        auto rrs = Model::ResourceRecordSet()
+                       .WithName(std::string(name) + ".")
+                       .WithType(Model::RRType::A)
+                       .WithTTL(60);
+        rrs.AddResourceRecords(Model::ResourceRecord().WithValue("10.0.0.1"));
+        rrs.AddResourceRecords(Model::ResourceRecord().WithValue("10.0.1." + std::to_string(name[0] - 'a' + 1)));
+        rrsets.push_back(rrs);
+    }
+    auto rrs = Model::ResourceRecordSet()
+                   .WithName("b.pyrotechnics.io.")
+                   .WithType(Model::RRType::AAAA)
+                   .WithTTL(60);
+    rrs.AddResourceRecords(Model::ResourceRecord().WithValue("fd00::b"));
+    rrsets.push_back(rrs);
+
+    auto zone = std::make_shared<DnsHandler::zone_t>();
+    DnsHandler::load_rrsets(*zone, rrsets);
+    zone->version = version;
+    return zone;
+}
+
+// Servers 1 (cluster alpha, subdomain a), 2 and 4 (cluster beta,
+// subdomain b)
+inline SrvCache::inventory_ptr inventory(uint64_t version = 3)
+{
+    auto inv = std::make_shared<SrvCache::inventory_t>();
+    inv->version = version;
+    inv->servers[1] = {"1", "10.0.0.1", "srv\"1", "5", "alpha", "a"};
+    inv->servers[2] = {"2", "10.0.0.2", "srv2", "6", "beta", "b"};
+    inv->servers[4] = {"4", "10.0.0.4", "srv4", "6", "beta", "b"};
+    inv->reindex();
+    return inv;
+}
+
+} // namespace fixtures
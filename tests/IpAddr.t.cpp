@@ -0,0 +1,73 @@
+#include <catch2/catch.hpp>
+#include <IpAddr.hpp>
+
+#include <set>
+#include <unordered_set>
+
+namespace {
+
+std::string canonical(const std::string &text)
+{
+    IpAddr ip;
+    return IpAddr::parse(text, ip) ? ip.to_string() : "invalid";
+}
+
+} // anonymous namespace
+
+TEST_CASE("IPv4 addresses are parsed strictly", "[IpAddr]")
+{
+    IpAddr ip;
+    REQUIRE(IpAddr::parse("192.16.42.2", ip));
+    REQUIRE(ip.is_v4());
+    REQUIRE(ip.v4() == 0xC0102A02);
+    REQUIRE(ip == IpAddr::from_v4(0xC0102A02));
+    REQUIRE(canonical("0.0.0.0") == "0.0.0.0");
+    REQUIRE(canonical("255.255.255.255") == "255.255.255.255");
+
+    for (auto bad : {"", "9999.1", "1.2.3", "1.2.3.4.5", "256.1.1.1", "01.2.3.4",
+                     "1..2.3", ".1.2.3", "1.2.3.", "1.2.3.4 ", "a.b.c.d", "1.2.3.-4"})
+    {
+        INFO(bad);
+        REQUIRE(!IpAddr::valid(bad));
+    }
+}
+
+TEST_CASE("IPv6 addresses are parsed strictly", "[IpAddr]")
+{
+    REQUIRE(canonical("::") == "::");
+    REQUIRE(canonical("::1") == "::1");
+    REQUIRE(canonical("1::") == "1::");
+    REQUIRE(canonical("2001:DB8:0:0:0:0:2:1") == "2001:db8::2:1");
+    REQUIRE(canonical("2001:db8:0:1:1:1:1:1") == "2001:db8:0:1:1:1:1:1");
+    REQUIRE(canonical("2001:0:0:1:0:0:0:1") == "2001:0:0:1::1");
+    REQUIRE(canonical("2001:db8:0:0:1:0:0:1") == "2001:db8::1:0:0:1");
+    REQUIRE(canonical("fe80::0202:b3ff:fe1e:8329") == "fe80::202:b3ff:fe1e:8329");
+    REQUIRE(canonical("64:ff9b::192.0.2.33") == "64:ff9b::c000:221");
+    REQUIRE(canonical("::ffff:10.0.0.1") == "10.0.0.1");
+
+    for (auto bad : {":", ":::", "1:2:3:4:5:6:7", "1:2:3:4:5:6:7:8:9", "1::2::3",
+                     "12345::", "1:2:3:4:5:6:7:8::", "::1:2:3:4:5:6:7:8", "1:", ":1",
+                     "g::1", "fe80::1%eth0", "::1.2.3", "1.2.3.4::", "1:2:3:4:5:6:7:1.2.3.4"})
+    {
+        INFO(bad);
+        REQUIRE(!IpAddr::valid(bad));
+    }
+    REQUIRE(IpAddr::valid("1:2:3:4:5:6:1.2.3.4"));
+    REQUIRE(IpAddr::valid("1:2:3:4:5:6:7::"));
+}
+
+TEST_CASE("Addresses order and hash by value", "[IpAddr]")
+{
+    IpAddr a, b, c;
+    REQUIRE(IpAddr::parse("10.0.0.1", a));
+    REQUIRE(IpAddr::parse("10.0.0.2", b));
+    REQUIRE(IpAddr::parse("::ffff:a00:1", c));
+    REQUIRE(a < b);
+    REQUIRE(a == c);
+    REQUIRE(std::hash<IpAddr>()(a) == std::hash<IpAddr>()(c));
+
+    std::unordered_set<IpAddr> seen = {a, b, c};
+    REQUIRE(seen.size() == 2);
+    std::set<IpAddr> ordered = {b, a};
+    REQUIRE(*ordered.begin() == a);
+}
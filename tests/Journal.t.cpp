@@ -0,0 +1,147 @@
+#include <catch2/catch.hpp>
+#include <Journal.hpp>
+#include <Fixtures.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+off_t file_size(const std::string &path)
+{
+    struct stat st = {};
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Finished entries are not recovered", "[Journal]")
+{
+    auto path = fixtures::scratch("finished");
+    {
+        Journal journal(path);
+        REQUIRE(journal.recover().empty());
+        auto seq = journal.begin({{false, "a.example.com", "10.0.0.1"}});
+        REQUIRE(seq > 0);
+        journal.submitted(seq, "C1", {0});
+        journal.applied(seq);
+        REQUIRE(journal.live() == 1);
+        journal.synced("C1");
+        REQUIRE(journal.live() == 0);
+    }
+    Journal journal(path);
+    REQUIRE(journal.recover().empty());
+    unlink(path.c_str());
+}
+
+TEST_CASE("Unfinished entries survive a restart", "[Journal]")
+{
+    auto path = fixtures::scratch("unfinished");
+    uint64_t first, second;
+    {
+        Journal journal(path);
+        journal.recover();
+
+        // Stopped between two submissions
+        first = journal.begin({{false, "a.example.com", "10.0.0.1"},
+                               {true, "b.example.com", "10.0.0.2"},
+                               {false, "c example.com", "%"}});
+        journal.submitted(first, "C1", {0});
+
+        // Applied, waiting for INSYNC
+        second = journal.begin({{false, "d.example.com", "2001:db8::1"}});
+        journal.submitted(second, "C2", {0});
+        journal.applied(second);
+    }
+
+    for (int restart = 0; restart < 2; restart++)
+    {
+        Journal journal(path);
+        auto entries = journal.recover();
+        REQUIRE(entries.size() == 2);
+
+        REQUIRE(entries[0].seq == first);
+        REQUIRE(entries[0].applied == false);
+        REQUIRE(entries[0].ops.size() == 3);
+        REQUIRE(entries[0].ops[1].remove == true);
+        REQUIRE(entries[0].ops[2].name == "c example.com");
+        REQUIRE(entries[0].ops[2].ip == "%");
+        REQUIRE(entries[0].submitted == std::vector<bool>{true, false, false});
+        REQUIRE(entries[0].changes == std::vector<std::string>{"C1"});
+
+        REQUIRE(entries[1].seq == second);
+        REQUIRE(entries[1].applied == true);
+        REQUIRE(entries[1].ops[0].ip == "2001:db8::1");
+        REQUIRE(entries[1].changes == std::vector<std::string>{"C2"});
+
+        // Numbering carries on after the recovered entries
+        REQUIRE(journal.live() == 2);
+        if (restart == 1)
+        {
+            auto seq = journal.begin({{false, "e.example.com", "10.0.0.5"}});
+            REQUIRE(seq > second);
+            journal.applied(seq);
+            journal.applied(first);
+            journal.synced("C1");
+            journal.synced("C2");
+            REQUIRE(journal.live() == 0);
+        }
+    }
+
+    Journal journal(path);
+    REQUIRE(journal.recover().empty());
+    unlink(path.c_str());
+}
+
+TEST_CASE("Torn and incomplete records are ignored", "[Journal]")
+{
+    auto path = fixtures::scratch("torn");
+    {
+        std::ofstream out(path);
+        out << "O 1 0 1 A a.example.com 10.0.0.1\n"
+            << "O 2 0 2 A b.example.com 10.0.0.2\n" // Second operation lost
+            << "garbage\n"
+            << "C 1 C1 0\n"
+            << "S C9\n"
+            << "O 3 0 1 A c.exa"; // Torn by the crash
+    }
+
+    Journal journal(path);
+    auto entries = journal.recover();
+    REQUIRE(entries.size() == 1);
+    REQUIRE(entries[0].seq == 1);
+    REQUIRE(entries[0].submitted == std::vector<bool>{true});
+    REQUIRE(entries[0].changes == std::vector<std::string>{"C1"});
+
+    // Compaction kept only entry 1
+    std::ifstream in(path);
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(in, line))
+        lines.push_back(line);
+    REQUIRE(lines == std::vector<std::string>{"O 1 0 1 A a.example.com 10.0.0.1", "C 1 C1 0"});
+    unlink(path.c_str());
+}
+
+TEST_CASE("The file is emptied once nothing is live", "[Journal]")
+{
+    auto path = fixtures::scratch("truncate");
+    Journal journal(path, 64);
+    journal.recover();
+    for (int i = 0; i < 3; i++)
+    {
+        auto seq = journal.begin({{false, "a.example.com", "10.0.0.1"}});
+        REQUIRE(seq > 0);
+        journal.submitted(seq, "C" + std::to_string(i), {0});
+        journal.applied(seq);
+        journal.synced("C" + std::to_string(i));
+    }
+    REQUIRE(journal.live() == 0);
+    REQUIRE(journal.ok());
+
+    // The last records are flushed in the background
+    for (int i = 0; i < 100 && file_size(path) != 0; i++)
+        std::this_thread::sleep_for(10ms);
+    REQUIRE(file_size(path) == 0);
+    unlink(path.c_str());
+}
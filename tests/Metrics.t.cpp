@@ -0,0 +1,52 @@
+#include <catch2/catch.hpp>
+#include <Metrics.hpp>
+
+TEST_CASE("Counters add up across threads", "[Metrics]")
+{
+    auto &requests = metrics::counter("test_requests_total", "Requests", {{"endpoint", "/dns"}});
+    REQUIRE(&requests == &metrics::counter("test_requests_total", "Requests", {{"endpoint", "/dns"}}));
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 8; i++)
+        workers.emplace_back([&] {
+            for (int n = 0; n < 1000; n++)
+                requests.inc();
+        });
+    for (auto &w : workers)
+        w.join();
+    REQUIRE(requests.value() == 8000);
+}
+
+TEST_CASE("Histograms bucket observations", "[Metrics]")
+{
+    auto &latency = metrics::histogram("test_latency_seconds", "Latency", {{"call", "Get\"Change"}});
+    latency.observe(200us);
+    latency.observe(3ms);
+    latency.observe(1min);
+    {
+        metrics::Timer timer(latency);
+    }
+
+    auto snap = latency.snapshot();
+    REQUIRE(snap.count == 4);
+    REQUIRE(snap.buckets[metrics::Histogram::bucket_count - 1] == 1);
+    REQUIRE(snap.sum > 60.0);
+
+    auto text = metrics::render();
+    REQUIRE(text.find("# TYPE test_latency_seconds histogram") != std::string::npos);
+    REQUIRE(text.find("test_latency_seconds_bucket{call=\"Get\\\"Change\",le=\"0.005\"} 3") != std::string::npos);
+    REQUIRE(text.find("test_latency_seconds_bucket{call=\"Get\\\"Change\",le=\"+Inf\"} 4") != std::string::npos);
+    REQUIRE(text.find("test_latency_seconds_count{call=\"Get\\\"Change\"} 4") != std::string::npos);
+}
+
+TEST_CASE("Gauges track in-flight work", "[Metrics]")
+{
+    auto &inflight = metrics::gauge("test_in_flight", "In flight");
+    {
+        metrics::InFlight one(inflight);
+        metrics::InFlight two(inflight);
+        REQUIRE(inflight.value() == 2);
+    }
+    REQUIRE(inflight.value() == 0);
+    REQUIRE(metrics::render().find("test_in_flight 0\n") != std::string::npos);
+}
@@ -0,0 +1,126 @@
+#include <catch2/catch.hpp>
+#include <PageCache.hpp>
+
+#include <zlib.h>
+
+TEST_CASE("Pages are cached per data version", "[PageCache]")
+{
+    PageCache cache;
+    REQUIRE(cache.find("dns", {1, 1}) == nullptr);
+
+    auto page = cache.store("dns", {1, 1}, "<html>one</html>");
+    REQUIRE(page->body == "<html>one</html>");
+    REQUIRE(page->etag.front() == '"');
+    REQUIRE(cache.find("dns", {1, 1}) == page);
+    REQUIRE(cache.find("dns", {2, 1}) == nullptr);
+    REQUIRE(cache.find("servers", {1, 1}) == nullptr);
+
+    // Identical content keeps its entity tag across versions
+    auto next = cache.store("dns", {2, 1}, "<html>one</html>");
+    REQUIRE(next->etag == page->etag);
+    REQUIRE(cache.find("dns", {1, 1}) == nullptr);
+    REQUIRE(cache.store("dns", {2, 2}, "<html>two</html>")->etag != page->etag);
+}
+
+TEST_CASE("Untracked data is never cached", "[PageCache]")
+{
+    PageCache cache;
+    cache.store("servers", {0, 3}, "body");
+    REQUIRE(cache.find("servers", {0, 3}) == nullptr);
+}
+
+TEST_CASE("Compressed bodies inflate to the original", "[PageCache]")
+{
+    std::string body(10000, 'x');
+    std::string compressed;
+    REQUIRE(PageCache::gzip(body, compressed));
+    REQUIRE(compressed.size() < body.size());
+
+    std::string inflated(body.size(), '\0');
+    z_stream zs = {};
+    REQUIRE(inflateInit2(&zs, 15 + 16) == Z_OK);
+    zs.next_in = reinterpret_cast<Bytef *>(&compressed[0]);
+    zs.avail_in = compressed.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&inflated[0]);
+    zs.avail_out = inflated.size();
+    REQUIRE(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+    inflateEnd(&zs);
+    REQUIRE(inflated == body);
+}
+
+TEST_CASE("Concurrent misses share one build", "[PageCache]")
+{
+    PageCache cache;
+    std::atomic<int> builds{0};
+    auto build = [&] {
+        builds++;
+        std::this_thread::sleep_for(100ms);
+        return std::string("<html>built</html>");
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<PageCache::page_ptr> pages(8);
+    for (size_t i = 0; i < pages.size(); i++)
+        threads.emplace_back([&, i] { pages[i] = cache.get("dns", {1, 1}, build); });
+    for (auto &t : threads)
+        t.join();
+
+    REQUIRE(builds == 1);
+    for (const auto &page : pages)
+        REQUIRE(page == pages[0]);
+
+    // Served from the cache, then rebuilt for new data
+    REQUIRE(cache.get("dns", {1, 1}, build) == pages[0]);
+    REQUIRE(cache.get("dns", {1, 2}, build) != pages[0]);
+    REQUIRE(builds == 2);
+}
+
+TEST_CASE("Single flight results and failures reach every caller", "[SingleFlight]")
+{
+    SingleFlight<int> flights;
+    std::atomic<int> calls{0};
+    std::atomic<int> shared{0};
+    auto slow = [&] {
+        calls++;
+        std::this_thread::sleep_for(100ms);
+        return 42;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<int> results(4);
+    for (size_t i = 0; i < results.size(); i++)
+        threads.emplace_back([&, i] {
+            bool joined = false;
+            results[i] = flights.run("answer", slow, &joined);
+            shared += joined;
+        });
+    for (auto &t : threads)
+        t.join();
+    REQUIRE(results == std::vector<int>(4, 42));
+    REQUIRE(calls == 1);
+    REQUIRE(shared == 3);
+    REQUIRE(flights.in_flight() == 0);
+
+    // Nothing is kept once the call is over
+    REQUIRE(flights.run("answer", slow) == 42);
+    REQUIRE(calls == 2);
+
+    auto failing = [&]() -> int {
+        std::this_thread::sleep_for(50ms);
+        throw std::runtime_error("backend down");
+    };
+    std::atomic<int> failures{0};
+    threads.clear();
+    for (int i = 0; i < 3; i++)
+        threads.emplace_back([&] {
+            try {
+                flights.run("answer", failing);
+            } catch (const std::runtime_error &) {
+                failures++;
+            }
+        });
+    for (auto &t : threads)
+        t.join();
+    REQUIRE(failures == 3);
+    REQUIRE(flights.in_flight() == 0);
+}
@@ -0,0 +1,225 @@
+#include <catch2/catch.hpp>
+#include <Prober.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Listening socket on 127.0.0.1, port 0 picks a free one
+int listen_on(uint16_t &port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+Prober::status_t find(Prober &prober, const std::string &name)
+{
+    for (const auto &st : prober.status())
+        if (st.name == name)
+            return st;
+    return {};
+}
+
+void wait_rounds(Prober &prober, uint64_t rounds)
+{
+    auto target = prober.rounds() + rounds;
+    for (int i = 0; i < 200 && prober.rounds() < target; i++)
+        std::this_thread::sleep_for(10ms);
+}
+
+} // anonymous namespace
+
+TEST_CASE("Dead addresses are pulled, live ones kept", "[Prober]")
+{
+    uint16_t port = 0;
+    int fd = listen_on(port);
+    REQUIRE(fd >= 0);
+
+    // Same port on another loopback address: connection refused
+    IpAddr live, dead;
+    REQUIRE(IpAddr::parse("127.0.0.1", live));
+    REQUIRE(IpAddr::parse("127.0.0.2", dead));
+
+    std::mutex mtx;
+    std::vector<std::string> log;
+    Prober::options_t options;
+    options.port = port;
+    options.interval = 20ms;
+    options.timeout = 500ms;
+    options.rise = 2;
+    options.fall = 2;
+    Prober prober(options,
+                  [&](Prober::targets_t &targets) {
+                      targets = {{"a.example.com", live}, {"b.example.com", dead}};
+                      return true;
+                  },
+                  [&](Prober::rotations_t &changes) {
+                      std::lock_guard<std::mutex> lock(mtx);
+                      for (auto &chg : changes)
+                      {
+                          log.push_back((chg.pull ? "pull " : "restore ") + chg.name);
+                          chg.ok = true;
+                      }
+                  });
+
+    wait_rounds(prober, 3);
+    REQUIRE(find(prober, "a.example.com").state == Prober::state_t::UP);
+    REQUIRE(find(prober, "a.example.com").pulled == false);
+    REQUIRE(find(prober, "b.example.com").state == Prober::state_t::DOWN);
+    REQUIRE(find(prober, "b.example.com").pulled == true);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        REQUIRE(log == std::vector<std::string>{"pull b.example.com"});
+    }
+    close(fd);
+}
+
+TEST_CASE("Pulls are capped", "[Prober]")
+{
+    uint16_t port = 0;
+    int fd = listen_on(port);
+    REQUIRE(fd >= 0);
+    close(fd); // Nothing listens there any more
+
+    IpAddr a, b;
+    REQUIRE(IpAddr::parse("127.0.0.1", a));
+    REQUIRE(IpAddr::parse("127.0.0.3", b));
+
+    std::atomic<int> pulls{0};
+    Prober::options_t options;
+    options.port = port;
+    options.interval = 20ms;
+    options.rise = 1;
+    options.fall = 1;
+    options.max_pulled = 1;
+    Prober prober(options,
+                  [&](Prober::targets_t &targets) {
+                      targets = {{"a.example.com", a}, {"b.example.com", b}};
+                      return true;
+                  },
+                  [&](Prober::rotations_t &changes) {
+                      for (auto &chg : changes)
+                      {
+                          pulls += chg.pull;
+                          chg.ok = true;
+                      }
+                  });
+
+    wait_rounds(prober, 3);
+    REQUIRE(find(prober, "a.example.com").state == Prober::state_t::DOWN);
+    REQUIRE(find(prober, "b.example.com").state == Prober::state_t::DOWN);
+    REQUIRE(pulls == 1);
+}
+
+TEST_CASE("HTTP checks read the status line", "[Prober]")
+{
+    uint16_t port = 0;
+    int fd = listen_on(port);
+    REQUIRE(fd >= 0);
+
+    // Answers 200 while healthy, 503 otherwise
+    std::atomic<bool> healthy{true};
+    std::thread server([&] {
+        for (;;)
+        {
+            int client = accept(fd, nullptr, nullptr);
+            if (client < 0)
+                return;
+            char buffer[512];
+            if (recv(client, buffer, sizeof(buffer), 0) > 0)
+            {
+                std::string reply = healthy ? "HTTP/1.0 200 OK\r\n\r\n"
+                                            : "HTTP/1.0 503 Service Unavailable\r\n\r\n";
+                send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+            }
+            close(client);
+        }
+    });
+
+    IpAddr ip;
+    REQUIRE(IpAddr::parse("127.0.0.1", ip));
+    Prober::options_t options;
+    options.check = Prober::check_t::HTTP;
+    options.path = "/health";
+    options.port = port;
+    options.interval = 20ms;
+    options.rise = 1;
+    options.fall = 1;
+    {
+        Prober prober(options,
+                      [&](Prober::targets_t &targets) {
+                          targets = {{"a.example.com", ip}};
+                          return true;
+                      },
+                      [](Prober::rotations_t &changes) {
+                          for (auto &chg : changes)
+                              chg.ok = true;
+                      });
+
+        wait_rounds(prober, 2);
+        REQUIRE(find(prober, "a.example.com").state == Prober::state_t::UP);
+        healthy = false;
+        wait_rounds(prober, 2);
+        REQUIRE(find(prober, "a.example.com").state == Prober::state_t::DOWN);
+        REQUIRE(find(prober, "a.example.com").pulled == true);
+        healthy = true;
+        wait_rounds(prober, 2);
+        REQUIRE(find(prober, "a.example.com").pulled == false);
+    }
+
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    server.join();
+}
+
+TEST_CASE("A refused pull does not hold the slot", "[Prober]")
+{
+    uint16_t port = 0;
+    int fd = listen_on(port);
+    REQUIRE(fd >= 0);
+    close(fd); // Nothing listens there any more
+
+    // Both are down, only b is published in DNS
+    IpAddr unpublished, published;
+    REQUIRE(IpAddr::parse("127.0.0.2", unpublished));
+    REQUIRE(IpAddr::parse("127.0.0.3", published));
+
+    Prober::options_t options;
+    options.port = port;
+    options.interval = 20ms;
+    options.rise = 1;
+    options.fall = 1;
+    options.max_pulled = 1;
+    Prober prober(options,
+                  [&](Prober::targets_t &targets) {
+                      targets = {{"a.example.com", unpublished}, {"b.example.com", published}};
+                      return true;
+                  },
+                  [&](Prober::rotations_t &changes) {
+                      for (auto &chg : changes)
+                          chg.ok = (chg.name == "b.example.com");
+                  });
+
+    wait_rounds(prober, 4);
+    REQUIRE(find(prober, "a.example.com").state == Prober::state_t::DOWN);
+    REQUIRE(find(prober, "a.example.com").pulled == false);
+    REQUIRE(find(prober, "a.example.com").refused == true);
+    REQUIRE(find(prober, "b.example.com").pulled == true);
+}
@@ -0,0 +1,37 @@
+#include <catch2/catch.hpp>
+#include <RateLimiter.hpp>
+
+TEST_CASE("Backoff is jittered within bounds", "[RateLimiter]")
+{
+    RateLimiter::options_t options;
+    options.base_delay = 10ms;
+    options.max_delay = 200ms;
+    RateLimiter limiter(options);
+
+    auto delay = 0ms;
+    for (int i = 0; i < 50; i++)
+    {
+        auto next = limiter.backoff(delay);
+        REQUIRE(next >= 10ms);
+        REQUIRE(next <= std::max(10ms, std::min(200ms, 3 * delay)));
+        delay = next;
+    }
+}
+
+TEST_CASE("Reads and changes have separate budgets", "[RateLimiter]")
+{
+    RateLimiter::options_t options;
+    options.read_rate = 2;
+    options.change_rate = 2;
+    RateLimiter limiter(options);
+
+    // Draining the read budget leaves changes unaffected
+    auto start = std::chrono::steady_clock::now();
+    limiter.acquire(RateLimiter::kind_t::READ);
+    limiter.acquire(RateLimiter::kind_t::READ);
+    limiter.acquire(RateLimiter::kind_t::CHANGE);
+    limiter.acquire(RateLimiter::kind_t::CHANGE);
+    REQUIRE(std::chrono::steady_clock::now() - start < 100ms);
+    limiter.acquire(RateLimiter::kind_t::READ);
+    REQUIRE(std::chrono::steady_clock::now() - start >= 400ms);
+}
@@ -0,0 +1,100 @@
+#include <catch2/catch.hpp>
+#include <Reconciler.hpp>
+
+namespace {
+
+SrvCache::row_t server(const std::string &id, const std::string &subdomain, const std::string &ip)
+{
+    return {id, ip, "server" + id, "1", "Cluster", subdomain};
+}
+
+DnsHandler::row_t record(const std::string &name, const std::vector<std::string> &ips)
+{
+    DnsHandler::iplist_t addrs;
+    for (const auto &text : ips)
+    {
+        IpAddr ip;
+        if (IpAddr::parse(text, ip))
+            addrs.push_back(ip);
+    }
+    return {name, addrs, 60, 'A'};
+}
+
+} // anonymous namespace
+
+TEST_CASE("Servers are matched to published addresses", "[Reconciler]")
+{
+    DnsHandler::records_t records = {
+        record("ca.example.com", {"10.0.0.1", "10.0.0.2"}),
+        record("us.example.com", {"10.0.1.1"}),
+        record("ca.other.com", {"10.0.0.3"})};
+    SrvCache::records_t servers = {
+        server("1", "ca", "10.0.0.1"),  // present
+        server("2", "ca", "10.0.1.1"),  // published on another subdomain
+        server("3", "ca", "10.0.0.3"),  // published on another domain
+        server("4", "us", "10.0.1.1"),  // present
+        server("5", "eu", "10.0.2.1"),  // no record at all
+        server("6", "ca", "10.0.0.1")}; // same address as server 1
+
+    Reconciler diff(records, servers, "example.com");
+    REQUIRE(diff.present() == 3);
+    REQUIRE(diff.missing() == 3);
+    REQUIRE(diff.published(0));
+    REQUIRE(!diff.published(1));
+    REQUIRE(!diff.published(2));
+    REQUIRE(diff.published(3));
+    REQUIRE(!diff.published(4));
+    REQUIRE(diff.published(5));
+
+    // 10.0.0.2 on ca and everything on other.com have no server
+    REQUIRE(diff.extra() == 2);
+    const auto &addresses = diff.addresses();
+    REQUIRE(addresses.size() == 4);
+    REQUIRE(addresses[0].server == 0);
+    REQUIRE(diff.next(0) == 5);
+    REQUIRE(diff.next(5) == Reconciler::npos);
+    REQUIRE(addresses[1].server == Reconciler::npos);
+    REQUIRE(addresses[2].server == 3);
+    REQUIRE(addresses[3].server == Reconciler::npos);
+}
+
+TEST_CASE("Addresses are compared by value", "[Reconciler]")
+{
+    DnsHandler::records_t records = {
+        record("ca.example.com", {"10.0.0.1", "fd00::1"})};
+    SrvCache::records_t servers = {
+        server("1", "ca", "10.0.0.10"),
+        server("2", "ca", "FD00:0::1"),   // same address, other spelling
+        server("3", "ca", "10.0.0.1.5"),  // invalid
+        server("4", "ca", "")};
+
+    Reconciler diff(records, servers, "example.com");
+    REQUIRE(!diff.published(0));
+    REQUIRE(diff.published(1));
+    REQUIRE(!diff.published(2));
+    REQUIRE(!diff.published(3));
+    REQUIRE(diff.extra() == 1);
+}
+
+TEST_CASE("Large inventories reconcile", "[Reconciler]")
+{
+    DnsHandler::records_t records;
+    SrvCache::records_t servers;
+    for (int c = 0; c < 100; c++)
+    {
+        std::vector<std::string> ips;
+        for (int s = 0; s < 100; s++)
+        {
+            auto ip = "10.1." + std::to_string(c) + "." + std::to_string(s);
+            servers.push_back(server(std::to_string(c * 100 + s), "c" + std::to_string(c), ip));
+            if (s % 2 == 0)
+                ips.push_back(ip);
+        }
+        records.push_back(record("c" + std::to_string(c) + ".example.com", ips));
+    }
+
+    Reconciler diff(records, servers, "example.com");
+    REQUIRE(diff.present() == 5000);
+    REQUIRE(diff.missing() == 5000);
+    REQUIRE(diff.extra() == 0);
+}
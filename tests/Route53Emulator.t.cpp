@@ -0,0 +1,184 @@
+#include <catch2/catch.hpp>
+#include <Route53Emulator.hpp>
+
+namespace {
+
+Model::Change change(Model::ChangeAction action, const std::string &name,
+                     std::vector<std::string> ips)
+{
+    auto rrs = Model::ResourceRecordSet().WithName(name)
+                                         .WithType(Model::RRType::A)
+                                         .WithTTL(60);
+    for (const auto &ip : ips)
+        rrs.AddResourceRecords(Model::ResourceRecord().WithValue(ip));
+    return Model::Change().WithAction(action).WithResourceRecordSet(rrs);
+}
+
+Model::ChangeResourceRecordSetsOutcome submit(Route53Emulator &r53, std::vector<Model::Change> changes)
+{
+    auto batch = Model::ChangeBatch();
+    for (const auto &chg : changes)
+        batch.AddChanges(chg);
+    return r53.ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()
+                                            .WithHostedZoneId(Route53Emulator::zone_id)
+                                            .WithChangeBatch(batch));
+}
+
+} // anonymous namespace
+
+TEST_CASE("Emulated zone is found by name", "[Route53Emulator]")
+{
+    Route53Emulator r53({"example.com"});
+    auto outcome = r53.ListHostedZonesByName(Model::ListHostedZonesByNameRequest());
+    REQUIRE(outcome.IsSuccess());
+    REQUIRE(outcome.GetResult().GetHostedZones().size() == 1);
+    REQUIRE(outcome.GetResult().GetHostedZones()[0].GetName() == "example.com.");
+}
+
+TEST_CASE("Change batches are validated and atomic", "[Route53Emulator]")
+{
+    Route53Emulator r53({"example.com"});
+    REQUIRE(submit(r53, {change(Model::ChangeAction::CREATE, "a.example.com", {"10.0.0.1"})}).IsSuccess());
+    REQUIRE(r53.size() == 1);
+
+    // Second change fails, so the first one must not apply either
+    auto outcome = submit(r53, {change(Model::ChangeAction::CREATE, "b.example.com", {"10.0.0.2"}),
+                                change(Model::ChangeAction::CREATE, "a.example.com", {"10.0.0.3"})});
+    REQUIRE(!outcome.IsSuccess());
+    REQUIRE(outcome.GetError().GetErrorType() == Route53Errors::INVALID_CHANGE_BATCH);
+    REQUIRE(r53.size() == 1);
+
+    // Deletes must match the published values
+    REQUIRE(!submit(r53, {change(Model::ChangeAction::DELETE_, "a.example.com", {"10.0.0.9"})}).IsSuccess());
+    REQUIRE(submit(r53, {change(Model::ChangeAction::UPSERT, "a.example.com", {"10.0.0.1", "10.0.0.2"})}).IsSuccess());
+    REQUIRE(submit(r53, {change(Model::ChangeAction::DELETE_, "a.example.com", {"10.0.0.2", "10.0.0.1"})}).IsSuccess());
+    REQUIRE(r53.size() == 0);
+
+    // UPSERT values count twice towards the 1000 value limit
+    std::vector<std::string> ips;
+    for (int i = 0; i < 501; i++)
+        ips.push_back("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+    REQUIRE(!submit(r53, {change(Model::ChangeAction::UPSERT, "a.example.com", ips)}).IsSuccess());
+    REQUIRE(submit(r53, {change(Model::ChangeAction::CREATE, "a.example.com", ips)}).IsSuccess());
+    REQUIRE(r53.change_calls() == 7);
+}
+
+TEST_CASE("Private zones are listed after their parent", "[Route53Emulator]")
+{
+    Route53Emulator::options_t options{"example.com"};
+    options.private_zones = {"us.example.com", "example-b.com", "ca.example.com"};
+    Route53Emulator r53(options);
+
+    auto outcome = r53.ListHostedZonesByName(Model::ListHostedZonesByNameRequest().WithDNSName("example.com"));
+    REQUIRE(outcome.IsSuccess());
+    const auto &zones = outcome.GetResult().GetHostedZones();
+    REQUIRE(zones.size() == 4);
+    REQUIRE(zones[0].GetName() == "example.com.");
+    REQUIRE(zones[0].GetConfig().GetPrivateZone() == false);
+    REQUIRE(zones[1].GetName() == "ca.example.com.");
+    REQUIRE(zones[1].GetConfig().GetPrivateZone() == true);
+    REQUIRE(zones[2].GetName() == "us.example.com.");
+    REQUIRE(zones[3].GetName() == "example-b.com.");
+
+    // Names outside the zone are rejected
+    auto ca = zones[1].GetId();
+    auto batch = Model::ChangeBatch().AddChanges(
+        change(Model::ChangeAction::CREATE, "a.us.example.com", {"10.0.0.1"}));
+    REQUIRE(!r53.ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()
+                                              .WithHostedZoneId(ca)
+                                              .WithChangeBatch(batch)).IsSuccess());
+    batch = Model::ChangeBatch().AddChanges(
+        change(Model::ChangeAction::CREATE, "a.ca.example.com", {"10.0.0.1"}));
+    REQUIRE(r53.ChangeResourceRecordSets(Model::ChangeResourceRecordSetsRequest()
+                                             .WithHostedZoneId(ca)
+                                             .WithChangeBatch(batch)).IsSuccess());
+    REQUIRE(r53.size() == 1);
+}
+
+TEST_CASE("Listings are paged", "[Route53Emulator]")
+{
+    Route53Emulator::options_t options{"example.com"};
+    options.max_items = 10;
+    Route53Emulator r53(options);
+
+    std::vector<Model::Change> changes;
+    for (int i = 0; i < 25; i++)
+        changes.push_back(change(Model::ChangeAction::CREATE,
+                                 "host" + std::to_string(100 + i) + ".example.com", {"10.0.0.1"}));
+    REQUIRE(submit(r53, changes).IsSuccess());
+
+    size_t listed = 0, pages = 0;
+    auto request = Model::ListResourceRecordSetsRequest().WithHostedZoneId("/hostedzone/" + Route53Emulator::zone_id);
+    while (true)
+    {
+        auto outcome = r53.ListResourceRecordSets(request);
+        REQUIRE(outcome.IsSuccess());
+        const auto &result = outcome.GetResult();
+        listed += result.GetResourceRecordSets().size();
+        pages++;
+        if (!result.GetIsTruncated())
+            break;
+        request.SetStartRecordName(result.GetNextRecordName());
+        request.SetStartRecordType(result.GetNextRecordType());
+    }
+    REQUIRE(listed == 25);
+    REQUIRE(pages == 3);
+
+    // Start name lookups land on the record itself
+    request.SetStartRecordName("host110.example.com");
+    request.SetStartRecordType(Model::RRType::A);
+    auto outcome = r53.ListResourceRecordSets(request);
+    REQUIRE(outcome.GetResult().GetResourceRecordSets()[0].GetName() == "host110.example.com.");
+}
+
+TEST_CASE("Names are listed by their labels from the right", "[Route53Emulator]")
+{
+    REQUIRE(Route53Emulator::compare_names("example.com.", "a.example.com.") < 0);
+    REQUIRE(Route53Emulator::compare_names("z.example.com", "a.b.example.com") > 0);
+    REQUIRE(Route53Emulator::compare_names("x.a.example.com", "a-b.example.com") < 0);
+    REQUIRE(Route53Emulator::compare_names("a.example.com.", "a.example.com") == 0);
+
+    // A subtree is contiguous
+    Route53Emulator r53({"example.com"});
+    REQUIRE(submit(r53, {change(Model::ChangeAction::CREATE, "a-b.example.com", {"10.0.0.1"}),
+                         change(Model::ChangeAction::CREATE, "x.a.example.com", {"10.0.0.2"}),
+                         change(Model::ChangeAction::CREATE, "a.example.com", {"10.0.0.3"}),
+                         change(Model::ChangeAction::CREATE, "b.example.com", {"10.0.0.4"})}).IsSuccess());
+    auto outcome = r53.ListResourceRecordSets(Model::ListResourceRecordSetsRequest()
+                                                  .WithHostedZoneId(Route53Emulator::zone_id)
+                                                  .WithStartRecordName("a.example.com"));
+    const auto &rrsets = outcome.GetResult().GetResourceRecordSets();
+    REQUIRE(rrsets.size() == 4);
+    REQUIRE(rrsets[0].GetName() == "a.example.com.");
+    REQUIRE(rrsets[1].GetName() == "x.a.example.com.");
+    REQUIRE(rrsets[2].GetName() == "a-b.example.com.");
+}
+
+TEST_CASE("Changes become INSYNC after the configured delay", "[Route53Emulator]")
+{
+    Route53Emulator::options_t options{"example.com"};
+    options.insync_delay = 100ms;
+    Route53Emulator r53(options);
+
+    auto outcome = submit(r53, {change(Model::ChangeAction::CREATE, "a.example.com", {"10.0.0.1"})});
+    REQUIRE(outcome.IsSuccess());
+    auto id = outcome.GetResult().GetChangeInfo().GetId();
+    auto status = [&] {
+        return r53.GetChange(Model::GetChangeRequest().WithId(id)).GetResult().GetChangeInfo().GetStatus();
+    };
+    REQUIRE(status() == Model::ChangeStatus::PENDING);
+    std::this_thread::sleep_for(150ms);
+    REQUIRE(status() == Model::ChangeStatus::INSYNC);
+    REQUIRE(!r53.GetChange(Model::GetChangeRequest().WithId("/change/unknown")).IsSuccess());
+}
+
+TEST_CASE("Throttling is injected", "[Route53Emulator]")
+{
+    Route53Emulator::options_t options{"example.com"};
+    options.throttle_rate = 1.0;
+    Route53Emulator r53(options);
+    auto outcome = r53.ListHostedZonesByName(Model::ListHostedZonesByNameRequest());
+    REQUIRE(!outcome.IsSuccess());
+    REQUIRE(outcome.GetError().GetErrorType() == Route53Errors::THROTTLING);
+    REQUIRE(outcome.GetError().ShouldRetry());
+}
@@ -0,0 +1,103 @@
+#include <catch2/catch.hpp>
+#include <Snapshot.hpp>
+#include <Fixtures.hpp>
+
+namespace {
+
+const std::string domain = "pyrotechnics.io";
+
+// The shared fixtures, plus a record without values and a server
+// with empty columns
+DnsHandler::zone_t make_zone()
+{
+    auto zone = *fixtures::zone();
+    zone.records.emplace_back("d.pyrotechnics.io", DnsHandler::iplist_t{},
+                              60, static_cast<char>(Model::RRType::A));
+    return zone;
+}
+
+SrvCache::inventory_t make_inventory()
+{
+    auto inventory = *fixtures::inventory();
+    inventory.servers[42] = {"42", "", "tsrv42", "", "", ""};
+    return inventory;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Zone and inventory survive a save and load", "[Snapshot]")
+{
+    auto path = fixtures::scratch("roundtrip");
+    auto before = std::chrono::system_clock::now() - 1s;
+    REQUIRE(snapshot::save(path, domain, make_zone(), make_inventory()));
+
+    snapshot::data_t data;
+    REQUIRE(snapshot::load(path, domain, data));
+    REQUIRE(data.records == make_zone().records);
+    REQUIRE(data.servers == make_inventory().servers);
+    REQUIRE(data.saved >= before);
+    REQUIRE(data.saved <= std::chrono::system_clock::now());
+
+    // Rows turn back into RRsets
+    DnsHandler::zone_t zone;
+    DnsHandler::load_records(zone, data.records);
+    REQUIRE(zone.rrsets.size() == 5);
+    REQUIRE(zone.records == data.records);
+    REQUIRE(zone.rrsets.count({"b.pyrotechnics.io.", Model::RRType::AAAA}) == 1);
+    unlink(path.c_str());
+}
+
+TEST_CASE("Damaged snapshots are rejected", "[Snapshot]")
+{
+    auto path = fixtures::scratch("damaged");
+    snapshot::data_t data;
+    REQUIRE(!snapshot::load(path, domain, data));
+
+    REQUIRE(snapshot::save(path, domain, make_zone(), make_inventory()));
+    std::string content;
+    {
+        std::ifstream in(path, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(in), {});
+    }
+
+    auto rewrite = [&](const std::string &bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << bytes;
+    };
+
+    // One flipped bit in the payload
+    auto flipped = content;
+    flipped[flipped.size() - 3] ^= 0x10;
+    rewrite(flipped);
+    REQUIRE(!snapshot::load(path, domain, data));
+
+    // Cut short, in the header and in the payload
+    rewrite(content.substr(0, 20));
+    REQUIRE(!snapshot::load(path, domain, data));
+    rewrite(content.substr(0, content.size() - 1));
+    REQUIRE(!snapshot::load(path, domain, data));
+
+    // Not a snapshot
+    rewrite(std::string(content.size(), 'x'));
+    REQUIRE(!snapshot::load(path, domain, data));
+    REQUIRE(data.records.empty());
+
+    rewrite(content);
+    REQUIRE(snapshot::load(path, domain, data));
+    unlink(path.c_str());
+}
+
+TEST_CASE("Snapshots of another domain are rejected", "[Snapshot]")
+{
+    auto path = fixtures::scratch("domain");
+    REQUIRE(snapshot::save(path, "example.com", make_zone(), make_inventory()));
+
+    snapshot::data_t data;
+    REQUIRE(!snapshot::load(path, domain, data));
+    REQUIRE(!snapshot::load(path, "ample.com", data));
+    REQUIRE(data.records.empty());
+    REQUIRE(snapshot::load(path, "example.com", data));
+
+    REQUIRE(!snapshot::save(path, std::string(256, 'x'), make_zone(), make_inventory()));
+    unlink(path.c_str());
+}
@@ -2,6 +2,8 @@
 
 #include <SrvCache.hpp>
 
+#include <atomic>
+
 TEST_CASE("Check if we can connect to the database", "[Database]")
 {
     // Test connection to the Heroku DB
@@ -69,3 +71,37 @@ TEST_CASE("Return server for domain and ip", "[Single entry]")
     REQUIRE(servers[0][SrvCache::NAME] == "tsrv2");
     REQUIRE(servers[0][SrvCache::IP_ADDR] == "192.16.42.2");
 }
+
+TEST_CASE("Serve parallel queries from the connection pool", "[Pool]")
+{
+    std::string con_str = "";
+    CHECK(secure_config("TEST_DATABASE", con_str, 200));
+    SrvCache sc(con_str, 2);
+    std::vector<std::thread> workers;
+    std::atomic<int> succeeded{0};
+    for (int i = 0; i < 8; i++)
+        workers.emplace_back([&] {
+            SrvCache::records_t servers;
+            if (sc.get_servers(servers))
+                succeeded++;
+        });
+    for (auto &w : workers)
+        w.join();
+    REQUIRE(succeeded == 8);
+}
+
+TEST_CASE("Serve queries from the in-process inventory", "[Inventory]")
+{
+    std::string con_str = "";
+    CHECK(secure_config("TEST_DATABASE", con_str, 200));
+    SrvCache sc(con_str);
+    for (int i = 0; i < 100 && !sc.inventory(); i++)
+        std::this_thread::sleep_for(100ms);
+    REQUIRE(sc.version() > 0);
+
+    SrvCache::records_t servers;
+    REQUIRE(sc.get_servers(servers, "test2.pyrotechnics.io", "192.16.42.2") == true);
+    REQUIRE(servers.size() == 1);
+    REQUIRE(servers[0][SrvCache::NAME] == "tsrv2");
+    REQUIRE(sc.inventory()->by_subdomain.at("test1").size() == 3);
+}
@@ -0,0 +1,31 @@
+#include <catch2/catch.hpp>
+#include <TokenBucket.hpp>
+
+TEST_CASE("The burst is served without waiting", "[TokenBucket]")
+{
+    TokenBucket bucket(10, 3);
+    for (int i = 0; i < 3; i++)
+        REQUIRE(bucket.try_acquire());
+    REQUIRE(!bucket.try_acquire());
+}
+
+TEST_CASE("Callers are held to the rate", "[TokenBucket]")
+{
+    TokenBucket bucket(20, 1);
+    auto start = TokenBucket::clock_t::now();
+    for (int i = 0; i < 5; i++)
+        bucket.acquire();
+
+    // One token up front, four more at 50ms each
+    auto elapsed = TokenBucket::clock_t::now() - start;
+    REQUIRE(elapsed >= 190ms);
+    REQUIRE(elapsed < 1s);
+}
+
+TEST_CASE("A zero rate does not limit", "[TokenBucket]")
+{
+    TokenBucket bucket(0, 1);
+    for (int i = 0; i < 100; i++)
+        REQUIRE(bucket.try_acquire());
+    REQUIRE(bucket.acquire() == TokenBucket::clock_t::duration::zero());
+}